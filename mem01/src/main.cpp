@@ -1,9 +1,13 @@
 #include "glog/logging.h"
+#include "memory/AllocationBackend.h"
 #include "memory/Container.h"
 #include "memory/ContainerFactory.h"
+#include "utilities/numaUtility.h"
 #include "utilities/utility.h"
 #include <QCoreApplication>
 #include <QDir>
+#include <cstring>
+#include <thread>
 
 using namespace esi;
 
@@ -17,6 +21,72 @@ void test01(ssize_t size) {
     auto dest = std::make_shared<Container<short>>(LocationGpu, *src);
 }
 
+// Measures how the container create/destroy throughput of the pool scales with the number of threads
+void benchmarkPoolScaling(size_t maxThreads, size_t iterationsPerThread) {
+    for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        double t1 = getCurrentTime();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < numThreads; t++) {
+            threads.emplace_back([iterationsPerThread]() {
+                ContainerFactory::ContainerStreamType stream = ContainerFactory::getNextStream();
+                for (size_t i = 0; i < iterationsPerThread; i++) {
+                    Container<float> container(LocationHost, stream, 1024 + (i % 8) * 4096);
+                    container.get()[0] = 0;
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        double t2 = getCurrentTime();
+        LOG(INFO) << "benchmarkPoolScaling: " << numThreads << " threads, "
+                  << numThreads * iterationsPerThread / (t2 - t1) << " containers/s";
+    }
+}
+
+// Measures the latency of container construction while the pool has to keep within its budget
+void benchmarkAcquireLatency(size_t numSizes, size_t iterations) {
+    ContainerFactory::ContainerStreamType stream = ContainerFactory::getNextStream();
+    ContainerFactory::setMemoryBudget(LocationHost, numSizes * 64 * 1024);
+
+    std::vector<double> latencies(iterations);
+    for (size_t i = 0; i < iterations; i++) {
+        size_t numel = 1024 + (i * 7919 % numSizes) * 1024;
+        double t1 = getCurrentTime();
+        Container<float> container(LocationHost, stream, numel);
+        double t2 = getCurrentTime();
+        container.get()[0] = 0;
+        latencies[i] = t2 - t1;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    LOG(INFO) << "benchmarkAcquireLatency: p50 " << latencies[iterations / 2] * 1e6 << " us, p99 "
+              << latencies[iterations * 99 / 100] * 1e6 << " us, max " << latencies.back() * 1e6 << " us";
+}
+
+// Measures the copy bandwidth from a thread on node 0 into buffers placed on each NUMA node
+void benchmarkNumaBandwidth(size_t numel, size_t iterations) {
+    ContainerFactory::ContainerStreamType stream = ContainerFactory::getNextStream();
+    numaBindThread(0);
+
+    Container<float> source(LocationHost, stream, numel, "numaSource");
+    std::fill(source.get(), source.get() + numel, 1.0f);
+    for (int node = 0; node < numaNodeCount(); node++) {
+        ContainerAllocation allocation;
+        allocation.numaNode = node;
+        Container<float> destination(LocationHost, stream, numel, allocation, "numaDestination");
+        std::memcpy(destination.get(), source.get(), numel * sizeof(float));
+
+        double t1 = getCurrentTime();
+        for (size_t i = 0; i < iterations; i++) {
+            std::memcpy(destination.get(), source.get(), numel * sizeof(float));
+        }
+        double t2 = getCurrentTime();
+        LOG(INFO) << "benchmarkNumaBandwidth: node 0 to node " << destination.getNumaNode() << ", "
+                  << iterations * numel * sizeof(float) / (t2 - t1) / 1e9 << " GB/s";
+    }
+}
+
 void initGlog(const char *appName) {
     char logFileName[512];
     snprintf(logFileName, sizeof(logFileName), "%s.log", appName);
@@ -40,6 +110,39 @@ void initGlog(const char *appName) {
 int main(int argc, char *argv[]) {
     initGlog(argv[0]);
 
+    // lets the allocator be compared on the same workload without rebuilding, e.g. ESI_HOST_ALLOCATION_BACKEND=thp
+    if (const char *backend = getenv("ESI_HOST_ALLOCATION_BACKEND")) {
+        ContainerFactory::setAllocationBackend(LocationHost, AllocationBackend::create(backend, LocationHost));
+    }
+
+    if (argc > 1 && strcmp(argv[1], "scaling") == 0) {
+        benchmarkPoolScaling(std::thread::hardware_concurrency(), 1000000);
+        // once more without thread caches, so every container goes through the global queues
+        ContainerFactory::setDefaultThreadCacheLimits({0, 0, 0});
+        benchmarkPoolScaling(std::thread::hardware_concurrency(), 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "latency") == 0) {
+        benchmarkAcquireLatency(4096, 100000);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "numa") == 0) {
+        benchmarkNumaBandwidth(64 * 1024 * 1024, 20);
+        return 0;
+    }
+
+    // fault in the large test01 buffers on all cores instead of in the copying thread
+    ContainerFactory::setPrefaultPolicy(ContainerFactory::PrefaultParallel, 16 * 1024 * 1024);
+    // allocate the buffers used by test01 upfront, so already the first iteration hits the pool
+#ifdef HAVE_CUDA
+    ContainerFactory::reserve(LocationHost, 102400000 * sizeof(short), 1, true);
+    ContainerFactory::reserve(LocationGpu, 102400000 * sizeof(short), 1, true);
+#else
+    // without CUDA, the destination container of test01 is a host container as well
+    ContainerFactory::reserve(LocationHost, 102400000 * sizeof(short), 2, true);
+#endif
+
     for (int i = 0; i < 10; i++) {
         double t1 = getCurrentTime();
         test01(102400000);
@@ -0,0 +1,316 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2017, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#include "AllocationBackend.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <glog/logging.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <utilities/numaUtility.h>
+
+using namespace std;
+
+BEGIN_NAMESPACE_ESI
+
+std::shared_ptr<AllocationBackend> AllocationBackend::create(const std::string &name,
+                                                             [[maybe_unused]] ContainerLocation location) {
+    if (name == "default") {
+#ifdef HAVE_CUDA
+        return std::make_shared<CudaBackend>(location);
+#else
+        return std::make_shared<HostBackend>();
+#endif
+    } else if (name == "malloc") {
+        return std::make_shared<AlignedMallocBackend>();
+    } else if (name == "mmap") {
+        return std::make_shared<MmapBackend>();
+    } else if (name == "thp") {
+        return std::make_shared<MmapBackend>(ContainerFactory::HugePagesTransparent, 0);
+    } else if (name == "hugetlbfs") {
+        return std::make_shared<MmapBackend>(ContainerFactory::HugePagesHugetlbfs, 0);
+    } else if (name == "pinned") {
+        return std::make_shared<PinnedBackend>();
+    } else if (name == "shared") {
+        return std::make_shared<SharedMemoryBackend>();
+    }
+#ifdef HAVE_CUDA
+    else if (name == "cuda") {
+        return std::make_shared<CudaBackend>(location);
+    }
+#endif
+    throw std::runtime_error("invalid argument: AllocationBackend: Unknown backend " + name);
+}
+
+size_t AllocationBackend::getSystemPageSize() {
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return pageSize;
+}
+
+void AlignedMallocBackend::allocate(Block &block, [[maybe_unused]] int numaNode) {
+    size_t alignment =
+        block.numBytes >= getSystemPageSize() ? getSystemPageSize() : ContainerFactory::sm_minimumAlignment;
+    void *memory = nullptr;
+    if (posix_memalign(&memory, alignment, block.numBytes) == 0) {
+        block.pointer = reinterpret_cast<uint8_t *>(memory);
+    }
+    block.zeroed = false;
+}
+
+void AlignedMallocBackend::free(const Block &block) { ::free(block.pointer); }
+
+MmapBackend::MmapBackend(ContainerFactory::HugePagePolicy policy, size_t hugePageThreshold)
+    : m_hugePagePolicy(policy), m_hugePageThreshold(hugePageThreshold) {}
+
+void MmapBackend::setHugePagePolicy(ContainerFactory::HugePagePolicy policy, size_t thresholdBytes) {
+    m_hugePagePolicy = policy;
+    m_hugePageThreshold = thresholdBytes;
+}
+
+bool MmapBackend::usesHugePages(size_t numBytes) const {
+    return m_hugePagePolicy != ContainerFactory::HugePagesOff && numBytes >= m_hugePageThreshold;
+}
+
+void MmapBackend::allocate(Block &block, int numaNode) {
+    if (usesHugePages(block.numBytes)) {
+        block.pointer = mapHugePages(block.numBytes, block);
+    } else {
+        block.pointer = mapPages(block.numBytes, getSystemPageSize(), block);
+    }
+    // Anonymous mappings always start out zeroed
+    block.zeroed = true;
+
+    // Place the pages before they are touched for the first time
+    if (block.pointer) {
+        numaPlaceMemory(block.pointer, block.mappedBytes, numaNode);
+    }
+}
+
+void MmapBackend::free(const Block &block) { munmap(block.pointer, block.mappedBytes); }
+
+uint8_t *MmapBackend::mapPages(size_t numBytes, size_t alignment, Block &block) {
+    // Map the alignment more than needed, so the buffer can start at an aligned address, and unmap the rest
+    size_t length = (numBytes + getSystemPageSize() - 1) & ~(getSystemPageSize() - 1);
+    size_t extraLength = alignment > getSystemPageSize() ? alignment : 0;
+    void *mapping = mmap(nullptr, length + extraLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t mappingStart = reinterpret_cast<uintptr_t>(mapping);
+    uintptr_t bufferStart = (mappingStart + alignment - 1) & ~(alignment - 1);
+    if (bufferStart > mappingStart) {
+        munmap(mapping, bufferStart - mappingStart);
+    }
+    size_t tailLength = mappingStart + length + extraLength - (bufferStart + length);
+    if (tailLength > 0) {
+        munmap(reinterpret_cast<void *>(bufferStart + length), tailLength);
+    }
+
+    block.mappedBytes = length;
+    return reinterpret_cast<uint8_t *>(bufferStart);
+}
+
+uint8_t *MmapBackend::mapHugePages(size_t numBytes, Block &block) {
+    if (m_hugePagePolicy == ContainerFactory::HugePagesHugetlbfs) {
+        size_t length = (numBytes + sm_hugePageSize - 1) & ~(sm_hugePageSize - 1);
+        void *mapping =
+            mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED) {
+            block.pageSize = sm_hugePageSize;
+            block.mappedBytes = length;
+            return reinterpret_cast<uint8_t *>(mapping);
+        }
+        // The hugetlbfs pool is exhausted or not configured, try transparent huge pages instead
+    }
+
+    // madvise also succeeds if transparent huge pages are disabled, so only report them if the kernel uses them
+    uint8_t *buffer = mapPages(numBytes, sm_hugePageSize, block);
+    if (buffer && madvise(buffer, block.mappedBytes, MADV_HUGEPAGE) == 0 && transparentHugePagesEnabled()) {
+        block.pageSize = sm_hugePageSize;
+    }
+    return buffer;
+}
+
+bool MmapBackend::transparentHugePagesEnabled() {
+    // The active mode is bracketed, e.g. "always [madvise] never". Both always and madvise honour MADV_HUGEPAGE.
+    static const bool enabled = []() {
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string modes;
+        std::getline(file, modes);
+        return modes.find("[always]") != std::string::npos || modes.find("[madvise]") != std::string::npos;
+    }();
+    return enabled;
+}
+
+PinnedBackend::PinnedBackend(ContainerFactory::HugePagePolicy policy, size_t hugePageThreshold)
+    : m_mmapBackend(policy, hugePageThreshold), m_lockedBytes(0), m_lockFailures(0) {}
+
+void PinnedBackend::allocate(Block &block, int numaNode) {
+    // Buffers are always mapped, so locking them never affects neighbouring allocations. They are not mapped with
+    // MAP_LOCKED, as that would fault in the pages before they are placed on their node.
+    m_mmapBackend.allocate(block, numaNode);
+    if (!block.pointer) {
+        return;
+    }
+
+    if (mlock(block.pointer, block.mappedBytes) == 0) {
+        m_lockedBytes += block.mappedBytes;
+        return;
+    }
+
+    int error = errno;
+    {
+        std::lock_guard<std::mutex> unlockedLock(m_unlockedMutex);
+        m_unlockedBuffers.insert(block.pointer);
+    }
+    if (m_lockFailures++ == 0) {
+        struct rlimit limit;
+        getrlimit(RLIMIT_MEMLOCK, &limit);
+        LOG(WARNING) << "PinnedBackend: Could not lock " << block.mappedBytes << " bytes (" << strerror(error)
+                     << "), " << m_lockedBytes << " bytes are locked and RLIMIT_MEMLOCK is "
+                     << (limit.rlim_cur == RLIM_INFINITY ? std::string("unlimited") : to_string(limit.rlim_cur))
+                     << ". Raise it with ulimit -l or in /etc/security/limits.conf. Falling back to pageable memory.";
+    }
+    // At least fault in all pages now, instead of in the middle of a frame
+    ContainerFactory::prefault(block.pointer, block.mappedBytes, ContainerFactory::getPrefaultPolicy());
+}
+
+void PinnedBackend::free(const Block &block) {
+    {
+        std::lock_guard<std::mutex> unlockedLock(m_unlockedMutex);
+        if (m_unlockedBuffers.erase(block.pointer) == 0) {
+            m_lockedBytes -= block.mappedBytes;
+        }
+    }
+    // Unmapping also unlocks the pages
+    m_mmapBackend.free(block);
+}
+
+void SharedMemoryBackend::allocate(Block &block, int numaNode) {
+    size_t length = (block.numBytes + getSystemPageSize() - 1) & ~(getSystemPageSize() - 1);
+    int file = memfd_create("esi-container", MFD_CLOEXEC);
+    if (file < 0) {
+        return;
+    }
+    void *mapping = MAP_FAILED;
+    if (ftruncate(file, static_cast<off_t>(length)) == 0) {
+        mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        close(file);
+        return;
+    }
+
+    block.pointer = reinterpret_cast<uint8_t *>(mapping);
+    block.mappedBytes = length;
+    block.zeroed = true;
+    numaPlaceMemory(block.pointer, length, numaNode);
+    std::lock_guard<std::mutex> fileDescriptorsLock(m_fileDescriptorsMutex);
+    m_fileDescriptors[block.pointer] = file;
+}
+
+void SharedMemoryBackend::free(const Block &block) {
+    munmap(block.pointer, block.mappedBytes);
+    std::lock_guard<std::mutex> fileDescriptorsLock(m_fileDescriptorsMutex);
+    auto fileDescriptorIterator = m_fileDescriptors.find(block.pointer);
+    if (fileDescriptorIterator != m_fileDescriptors.end()) {
+        // Processes that still map the buffer keep the memory file alive
+        close(fileDescriptorIterator->second);
+        m_fileDescriptors.erase(fileDescriptorIterator);
+    }
+}
+
+int SharedMemoryBackend::getFileDescriptor(const uint8_t *buffer) {
+    std::lock_guard<std::mutex> fileDescriptorsLock(m_fileDescriptorsMutex);
+    auto fileDescriptorIterator = m_fileDescriptors.find(buffer);
+    return fileDescriptorIterator != m_fileDescriptors.end() ? fileDescriptorIterator->second : -1;
+}
+
+HostBackend::HostBackend() : m_mmapBackend(ContainerFactory::HugePagesTransparent, 4 * 1024 * 1024) {}
+
+void HostBackend::allocate(Block &block, int numaNode) {
+    if (m_mmapBackend.usesHugePages(block.numBytes) ||
+        ((block.zeroed || numaNodeCount() > 1) && block.numBytes >= getSystemPageSize())) {
+        m_mmapBackend.allocate(block, numaNode);
+    } else {
+        m_mallocBackend.allocate(block, numaNode);
+    }
+}
+
+void HostBackend::free(const Block &block) {
+    if (block.mappedBytes > 0) {
+        m_mmapBackend.free(block);
+    } else {
+        m_mallocBackend.free(block);
+    }
+}
+
+void HostBackend::setHugePagePolicy(ContainerFactory::HugePagePolicy policy, size_t thresholdBytes) {
+    m_mmapBackend.setHugePagePolicy(policy, thresholdBytes);
+}
+
+#ifdef HAVE_CUDA
+CudaBackend::CudaBackend(ContainerLocation location) : m_location(location) {}
+
+void CudaBackend::allocate(Block &block, int numaNode) {
+    cudaError_t error;
+    switch (m_location) {
+    case LocationGpu:
+        error = cudaMalloc((void **)&block.pointer, block.numBytes);
+        break;
+    case LocationBoth:
+        error = cudaMallocManaged((void **)&block.pointer, block.numBytes);
+        break;
+    case LocationHost:
+        // cudaMallocHost does not take a NUMA node, so the buffer is mapped and placed on its node first and then
+        // page-locked and registered with the driver, which faults in all its pages
+        m_mmapBackend.allocate(block, numaNode);
+        if (!block.pointer) {
+            return;
+        }
+        error = cudaHostRegister(block.pointer, block.mappedBytes, cudaHostRegisterDefault);
+        if (error != cudaSuccess) {
+            m_mmapBackend.free(block);
+            block.pointer = nullptr;
+        }
+        break;
+    default:
+        throw std::runtime_error("invalid argument: Container: Unknown location given");
+    }
+    // Anonymous mappings start out zeroed, the memory of the CUDA allocators does not
+    block.zeroed = block.pointer && m_location == LocationHost;
+    // Running out of memory is reported by the pointer, so the factory can release cached buffers and retry
+    if (error == cudaErrorMemoryAllocation) {
+        cudaGetLastError();
+        block.pointer = nullptr;
+    } else {
+        cudaSafeCall(error);
+    }
+}
+
+void CudaBackend::free(const Block &block) {
+    if (m_location == LocationHost) {
+        cudaHostUnregister(block.pointer);
+        m_mmapBackend.free(block);
+    } else {
+        cudaFree(block.pointer);
+    }
+}
+#endif
+
+constexpr size_t MmapBackend::sm_hugePageSize;
+
+END_NAMESPACE_ESI
@@ -0,0 +1,177 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2017, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#ifndef __ALLOCATIONBACKEND_H__
+#define __ALLOCATIONBACKEND_H__
+
+#include "ContainerFactory.h"
+#include "esiglobal.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+BEGIN_NAMESPACE_ESI
+
+/// Strategy the ContainerFactory uses to get buffers from and return them to the system, when the pool cannot
+/// serve a request. One backend is selected per location with ContainerFactory::setAllocationBackend.
+class AllocationBackend {
+  public:
+    /// A buffer allocated by a backend
+    struct Block {
+        uint8_t *pointer;
+        size_t numBytes;
+        /// Size of the pages backing the buffer
+        size_t pageSize;
+        /// Length of the mapping if the buffer has been mapped directly, 0 otherwise
+        size_t mappedBytes;
+        /// Set by the caller if it needs the buffer zeroed, so the backend can prefer fresh pages. Set by the
+        /// backend to whether the buffer is known to be zeroed.
+        bool zeroed;
+    };
+
+    virtual ~AllocationBackend(){};
+    virtual const char *getName() const = 0;
+    /// Allocates block.numBytes on the given NUMA node and fills in the other members of block. NumaNodeLocal
+    /// leaves the placement to the first touch of each page. Host buffers must be aligned to
+    /// ContainerFactory::sm_minimumAlignment, and to the page size if they span at least a page.
+    /// Leaves block.pointer at nullptr if the allocation fails.
+    virtual void allocate(Block &block, int numaNode) = 0;
+    virtual void free(const Block &block) = 0;
+    /// Returns whether the pages of the buffers are locked, so they cannot be dropped while the buffer is mapped
+    virtual bool pagesLocked() const { return false; };
+
+    /// Creates a backend by its name: "default", "malloc", "mmap", "thp", "hugetlbfs", "pinned", "shared" and,
+    /// with CUDA, "cuda"
+    static std::shared_ptr<AllocationBackend> create(const std::string &name, ContainerLocation location);
+    static size_t getSystemPageSize();
+};
+
+/// Host memory from posix_memalign
+class AlignedMallocBackend : public AllocationBackend {
+  public:
+    const char *getName() const { return "malloc"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+};
+
+/// Host memory mapped directly from the kernel, placed on its NUMA node before it is touched and optionally
+/// backed by huge pages
+class MmapBackend : public AllocationBackend {
+  public:
+    MmapBackend(ContainerFactory::HugePagePolicy policy = ContainerFactory::HugePagesOff,
+                size_t hugePageThreshold = 0);
+
+    const char *getName() const { return "mmap"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+
+    /// Huge pages are used for buffers of at least thresholdBytes
+    void setHugePagePolicy(ContainerFactory::HugePagePolicy policy, size_t thresholdBytes);
+    bool usesHugePages(size_t numBytes) const;
+    /// Returns whether the kernel backs MADV_HUGEPAGE mappings with transparent huge pages. Single faults can
+    /// still fall back to small pages if no huge page is available.
+    static bool transparentHugePagesEnabled();
+
+    static constexpr size_t sm_hugePageSize = 2 * 1024 * 1024; // [bytes]
+
+  private:
+    uint8_t *mapPages(size_t numBytes, size_t alignment, Block &block);
+    uint8_t *mapHugePages(size_t numBytes, Block &block);
+
+    ContainerFactory::HugePagePolicy m_hugePagePolicy;
+    size_t m_hugePageThreshold;
+};
+
+/// Page-locked host memory for the CPU-only build, the counterpart of cudaMallocHost. Buffers are mapped, placed
+/// on their NUMA node and then locked with mlock, which also faults in all their pages, so they can neither be
+/// swapped out nor migrated. If RLIMIT_MEMLOCK does not allow locking a buffer, it stays pageable but is still
+/// prefaulted, and a warning with the limit is logged once.
+class PinnedBackend : public AllocationBackend {
+  public:
+    PinnedBackend(ContainerFactory::HugePagePolicy policy = ContainerFactory::HugePagesTransparent,
+                  size_t hugePageThreshold = 4 * 1024 * 1024);
+
+    const char *getName() const { return "pinned"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+    bool pagesLocked() const { return true; };
+
+    /// Returns the number of bytes of the live buffers that are locked
+    size_t getLockedBytes() const { return m_lockedBytes; };
+    /// Returns the number of buffers that could not be locked so far
+    size_t getLockFailures() const { return m_lockFailures; };
+
+  private:
+    MmapBackend m_mmapBackend;
+    std::atomic<size_t> m_lockedBytes;
+    std::atomic<size_t> m_lockFailures;
+    /// The live buffers that could not be locked
+    std::mutex m_unlockedMutex;
+    std::unordered_set<const uint8_t *> m_unlockedBuffers;
+};
+
+/// Host memory in memory files (memfd), one per buffer, so other processes can map it. See SharedMemoryHandle.
+class SharedMemoryBackend : public AllocationBackend {
+  public:
+    const char *getName() const { return "shared"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+
+    /// Returns the descriptor of the memory file of the given buffer, -1 if it has not been allocated here
+    int getFileDescriptor(const uint8_t *buffer);
+
+  private:
+    std::mutex m_fileDescriptorsMutex;
+    std::unordered_map<const uint8_t *, int> m_fileDescriptors;
+};
+
+/// The default host backend of the CPU-only build. Maps buffers directly where huge pages, NUMA placement or
+/// zeroed pages pay off and uses aligned malloc for all others.
+class HostBackend : public AllocationBackend {
+  public:
+    HostBackend();
+
+    const char *getName() const { return "default"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+
+    void setHugePagePolicy(ContainerFactory::HugePagePolicy policy, size_t thresholdBytes);
+
+  private:
+    MmapBackend m_mmapBackend;
+    AlignedMallocBackend m_mallocBackend;
+};
+
+#ifdef HAVE_CUDA
+/// Device, managed or page-locked host memory from the CUDA runtime, depending on the location. Host buffers are
+/// mapped and placed on their NUMA node like with MmapBackend, and then registered with cudaHostRegister.
+class CudaBackend : public AllocationBackend {
+  public:
+    explicit CudaBackend(ContainerLocation location);
+
+    const char *getName() const { return "cuda"; };
+    void allocate(Block &block, int numaNode);
+    void free(const Block &block);
+    bool pagesLocked() const { return m_location == LocationHost; };
+
+  private:
+    ContainerLocation m_location;
+    MmapBackend m_mmapBackend;
+};
+#endif
+
+END_NAMESPACE_ESI
+
+#endif //!__ALLOCATIONBACKEND_H__
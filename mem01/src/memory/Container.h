@@ -15,6 +15,7 @@
 //#define HAVE_CUDA
 
 #include "ContainerFactory.h"
+#include "FrameArena.h"
 #include "esiglobal.h"
 #ifdef HAVE_CUDA
 #include "utilities/cudaUtility.h"
@@ -24,6 +25,7 @@
 #include <cassert>
 #include <exception>
 #include <memory>
+#include <string>
 #include <vector>
 
 BEGIN_NAMESPACE_ESI
@@ -38,10 +40,15 @@ template <typename T> class Container : public ContainerBase {
   public:
     typedef ContainerFactory::ContainerStreamType ContainerStreamType;
 
-    Container(ContainerLocation location, ContainerStreamType associatedStream, size_t numel, const char *name = nullptr) {
-        assert(numel > 0);
+    Container(ContainerLocation location, ContainerStreamType associatedStream, size_t numel, const char *name = nullptr)
+        : Container(location, associatedStream, numel, ContainerAllocation(), name){};
+
+    Container(ContainerLocation location, ContainerStreamType associatedStream, size_t numel,
+              const ContainerAllocation &allocation, const char *name = nullptr) {
+        assert(numel > 0 || allocation.maxNumBytes > 0);
 #ifndef HAVE_CUDA
-        location = LocationHost;
+        if (location != LocationShared)
+            location = LocationHost;
 #endif
 #ifdef HAVE_CUDA
         // m_creationEvent = nullptr;
@@ -49,11 +56,57 @@ template <typename T> class Container : public ContainerBase {
         m_numel = numel;
         m_location = location;
         m_associatedStream = associatedStream;
-        if (name)
+        m_allocation = allocation;
+#ifdef HAVE_CUDA
+        m_allocation.stream = associatedStream;
+#endif
+        if (name) {
             strcpy(m_name, name);
+            m_allocation.name = m_name;
+        }
 
-        m_buffer =
-            reinterpret_cast<T *>(ContainerFactoryContainerInterface::acquireMemory(m_numel * sizeof(T), m_location));
+        m_buffer = reinterpret_cast<T *>(
+            ContainerFactoryContainerInterface::acquireMemory(m_numel * sizeof(T), m_location, m_allocation));
+        ContainerFactoryContainerInterface::accountAcquire(m_numel * sizeof(T), m_allocation);
+    };
+
+    // constructs the container into the given frame arena, it must be destroyed before the arena is reset
+    Container(FrameArena &frameArena, ContainerStreamType associatedStream, size_t numel, const char *name = nullptr)
+        : Container(frameArena.getLocation(), associatedStream, numel, frameArena.getAllocation(), name){};
+
+    // maps numel elements of the given file starting at offset bytes, or the rest of the file if numel is 0, into
+    // a host container without copying. The pages are loaded lazily when they are accessed.
+    Container(const std::string &filename, FileMappingMode mode, FileAccessHint hint,
+              ContainerStreamType associatedStream, size_t offset = 0, size_t numel = 0, const char *name = nullptr) {
+        assert(offset % sizeof(T) == 0);
+        m_location = LocationHost;
+        m_associatedStream = associatedStream;
+        if (name) {
+            strcpy(m_name, name);
+            m_allocation.name = m_name;
+        }
+
+        size_t numBytes = numel * sizeof(T);
+        m_buffer = reinterpret_cast<T *>(
+            ContainerFactoryContainerInterface::mapFile(filename, mode, hint, offset, numBytes, m_allocation));
+        m_numel = numBytes / sizeof(T);
+        assert(m_numel > 0);
+        ContainerFactoryContainerInterface::accountAcquire(numBytes, m_allocation);
+    };
+
+    // attaches to a LocationShared container of another process without copying
+    Container(const SharedMemoryHandle &handle, ContainerStreamType associatedStream, const char *name = nullptr) {
+        assert(handle.numBytes >= sizeof(T));
+        m_location = LocationShared;
+        m_associatedStream = associatedStream;
+        if (name) {
+            strcpy(m_name, name);
+            m_allocation.name = m_name;
+        }
+
+        m_buffer = reinterpret_cast<T *>(ContainerFactoryContainerInterface::attachSharedMemory(handle, m_allocation));
+        m_numel = handle.numBytes / sizeof(T);
+        ContainerFactoryContainerInterface::accountAcquire(handle.numBytes, m_allocation);
     };
 
     Container(ContainerLocation location, ContainerStreamType associatedStream, const std::vector<T> &data,
@@ -127,6 +180,12 @@ template <typename T> class Container : public ContainerBase {
     };
 
     ~Container() {
+        ContainerFactoryContainerInterface::accountReturn(m_allocation);
+        // Frame arena memory is released as a whole at the end of the frame
+        if (m_allocation.frameArena) {
+            m_allocation.frameArena->containerReleased();
+            return;
+        }
 #ifdef HAVE_CUDA
         auto ret = cudaStreamQuery(m_associatedStream);
         if (ret != cudaSuccess && ret != cudaErrorNotReady && ret != cudaErrorCudartUnloading) {
@@ -136,21 +195,22 @@ template <typename T> class Container : public ContainerBase {
         else if (ret != cudaErrorCudartUnloading) {
             if (ret == cudaSuccess) {
                 ContainerFactoryContainerInterface::returnMemory(reinterpret_cast<uint8_t *>(m_buffer),
-                                                                 m_numel * sizeof(T), m_location);
+                                                                 m_numel * sizeof(T), m_location, m_allocation);
             } else {
                 auto buffer = m_buffer;
                 auto numel = m_numel;
                 auto location = m_location;
-                addCallbackStream(
-                    [buffer, numel, location]([[maybe_unused]] cudaStream_t s, [[maybe_unused]] cudaError_t e) -> void {
-                        ContainerFactoryContainerInterface::returnMemory(reinterpret_cast<uint8_t *>(buffer),
-                                                                         numel * sizeof(T), location);
-                    });
+                auto allocation = m_allocation;
+                addCallbackStream([buffer, numel, location, allocation]([[maybe_unused]] cudaStream_t s,
+                                                                        [[maybe_unused]] cudaError_t e) -> void {
+                    ContainerFactoryContainerInterface::returnMemory(reinterpret_cast<uint8_t *>(buffer),
+                                                                     numel * sizeof(T), location, allocation);
+                });
             }
         }
 #else
         ContainerFactoryContainerInterface::returnMemory(reinterpret_cast<uint8_t *>(m_buffer), m_numel * sizeof(T),
-                                                         m_location);
+                                                         m_location, m_allocation);
 #endif
     };
 
@@ -195,11 +255,38 @@ template <typename T> class Container : public ContainerBase {
 
     // returns the number of elements that can be stored in this container
     size_t size() const { return m_numel; };
+    // returns the number of elements a growable container can grow to, its size for all others
+    size_t capacity() const { return m_allocation.maxNumBytes > 0 ? m_allocation.maxNumBytes / sizeof(T) : m_numel; };
+
+    // changes the size of a growable container. Its buffer does not move, the content up to the smaller size stays.
+    void resize(size_t numel) {
+        assert(m_allocation.maxNumBytes > 0);
+        ContainerFactoryContainerInterface::growMemory(numel * sizeof(T), m_allocation);
+        ContainerFactoryContainerInterface::accountResize(numel * sizeof(T), m_allocation);
+        m_numel = numel;
+    }
+
+    // appends the given elements to a growable container without copying its existing content
+    void append(const T *dataBegin, const T *dataEnd) {
+        size_t numelBefore = m_numel;
+        resize(m_numel + (dataEnd - dataBegin));
+        std::copy(dataBegin, dataEnd, this->get() + numelBefore);
+    }
 
     bool isHost() const { return m_location == ContainerLocation::LocationHost; };
     bool isGPU() const { return m_location == ContainerLocation::LocationGpu; };
     bool isBoth() const { return m_location == ContainerLocation::LocationBoth; };
+    bool isShared() const { return m_location == ContainerLocation::LocationShared; };
+    // returns the handle another process can attach to this LocationShared container with
+    SharedMemoryHandle getSharedMemoryHandle() const {
+        return ContainerFactory::getSharedMemoryHandle(reinterpret_cast<const uint8_t *>(m_buffer),
+                                                       m_numel * sizeof(T));
+    };
     ContainerLocation getLocation() const { return m_location; };
+    // returns the alignment of the buffer in bytes, capped at the page size
+    size_t getAlignment() const { return ContainerFactory::getAlignment(reinterpret_cast<const uint8_t *>(m_buffer)); };
+    // returns the NUMA node of the buffer, or NumaNodeInterleave
+    int getNumaNode() const { return m_allocation.numaNode; };
     ContainerStreamType getStream() const { return m_associatedStream; }
     DataType getType() const { return DataTypeGet<T>(); }
 
@@ -232,6 +319,7 @@ template <typename T> class Container : public ContainerBase {
     // The number of elements this container can store
     size_t m_numel;
     ContainerLocation m_location;    
+    ContainerAllocation m_allocation;
 
     ContainerStreamType m_associatedStream;
     T *m_buffer;
@@ -10,93 +10,1536 @@
 // ================================================================================================
 
 #include "ContainerFactory.h"
+#include "AllocationBackend.h"
+#include "FrameArena.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
 #include <glog/logging.h>
+#include <limits>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <utilities/numaUtility.h>
 #include <utilities/utility.h>
 
 using namespace std;
 
 BEGIN_NAMESPACE_ESI
 
+/// Magazines of buffers owned by a single thread. Serving from and returning to them does not need any shared lock,
+/// they only exchange batches of buffers with the global queues. Each cache is registered, so the garbage collection
+/// can free the magazines that expired and eviction can hand cached buffers back to the global queues. Its mutex
+/// is only contended while that happens.
+class ContainerFactory::ThreadCache {
+  public:
+    ThreadCache() : m_limits(sm_defaultThreadCacheLimits), m_numBytes(0) {
+        std::lock_guard<std::mutex> registryLock(sm_threadCachesMutex);
+        sm_threadCaches.insert(this);
+    }
+    ~ThreadCache() {
+        {
+            std::lock_guard<std::mutex> registryLock(sm_threadCachesMutex);
+            sm_threadCaches.erase(this);
+        }
+        flush();
+    }
+
+    uint8_t *pop(SizeClass &sizeClass, ContainerLocation location) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        size_t numBytes = sizeClass.numBytes;
+        if (!cacheable(numBytes)) {
+            uint8_t *buffer = nullptr;
+            popFromQueue(sizeClass, &buffer, 1);
+            return buffer;
+        }
+
+        Magazine &magazine = m_magazines[location][&sizeClass];
+        if (magazine.buffers.empty()) {
+            // Refill a batch from the global queue, as far as the limits allow
+            size_t maxCount = std::min(m_limits.batchSize, m_limits.maxBuffersPerSize);
+            maxCount = std::min(maxCount, (m_limits.maxBytes - m_numBytes) / numBytes);
+            maxCount = std::max(maxCount, static_cast<size_t>(1));
+            magazine.buffers.resize(maxCount);
+            size_t count = popFromQueue(sizeClass, magazine.buffers.data(), maxCount);
+            magazine.buffers.resize(count);
+            magazine.lastUseTime = getCurrentTime();
+            m_numBytes += count * numBytes;
+        }
+        if (magazine.buffers.empty()) {
+            return nullptr;
+        }
+
+        uint8_t *buffer = magazine.buffers.back();
+        magazine.buffers.pop_back();
+        m_numBytes -= numBytes;
+        return buffer;
+    }
+
+    void push(uint8_t *pointer, SizeClass &sizeClass, ContainerLocation location) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        size_t numBytes = sizeClass.numBytes;
+        if (!cacheable(numBytes)) {
+            pushToQueue(sizeClass, location, &pointer, 1);
+            return;
+        }
+
+        Magazine &magazine = m_magazines[location][&sizeClass];
+        magazine.buffers.push_back(pointer);
+        magazine.lastUseTime = getCurrentTime();
+        m_numBytes += numBytes;
+        if (magazine.buffers.size() > m_limits.maxBuffersPerSize) {
+            flushBatch(magazine, sizeClass, location, m_limits.batchSize);
+        }
+        // If still above the byte limit, hand back whole magazines, keeping the one just used for last
+        for (ContainerLocation l = LocationHost; l < LocationINVALID && m_numBytes > m_limits.maxBytes;
+             l = static_cast<ContainerLocation>(l + 1)) {
+            for (auto &entry : m_magazines[l]) {
+                if (&entry.second != &magazine && m_numBytes > m_limits.maxBytes) {
+                    flushBatch(entry.second, *entry.first, l, entry.second.buffers.size());
+                }
+            }
+        }
+        if (m_numBytes > m_limits.maxBytes) {
+            flushBatch(magazine, sizeClass, location, magazine.buffers.size());
+        }
+    }
+
+    /// Takes a slot of the given slab class, nullptr if all its arenas are full
+    uint8_t *popSlot(SlabClass &slabClass, ContainerLocation location) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        uint8_t *slot = nullptr;
+        if (!slotsCacheable()) {
+            takeSlabSlots(slabClass, &slot, 1);
+            return slot;
+        }
+
+        Magazine &magazine = m_slotMagazines[location][&slabClass];
+        if (magazine.buffers.empty()) {
+            size_t maxCount = std::min(m_limits.batchSize, m_limits.maxBuffersPerSize);
+            magazine.buffers.resize(maxCount);
+            magazine.buffers.resize(takeSlabSlots(slabClass, magazine.buffers.data(), maxCount));
+            magazine.lastUseTime = getCurrentTime();
+        }
+        if (!magazine.buffers.empty()) {
+            slot = magazine.buffers.back();
+            magazine.buffers.pop_back();
+        }
+        return slot;
+    }
+
+    void pushSlot(uint8_t *slot, SlabClass &slabClass, ContainerLocation location) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        if (!slotsCacheable()) {
+            returnSlabSlots(slabClass, location, &slot, 1);
+            return;
+        }
+
+        Magazine &magazine = m_slotMagazines[location][&slabClass];
+        magazine.buffers.push_back(slot);
+        magazine.lastUseTime = getCurrentTime();
+        if (magazine.buffers.size() > m_limits.maxBuffersPerSize) {
+            flushSlots(magazine, slabClass, location, m_limits.batchSize);
+        }
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        for (ContainerLocation location = LocationHost; location < LocationINVALID;
+             location = static_cast<ContainerLocation>(location + 1)) {
+            for (auto &entry : m_magazines[location]) {
+                flushBatch(entry.second, *entry.first, location, entry.second.buffers.size());
+            }
+            for (auto &entry : m_slotMagazines[location]) {
+                flushSlots(entry.second, *entry.first, location, entry.second.buffers.size());
+            }
+        }
+    }
+
+    void setLimits(const ThreadCacheLimits &limits) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        m_limits = limits;
+        for (ContainerLocation location = LocationHost; location < LocationINVALID;
+             location = static_cast<ContainerLocation>(location + 1)) {
+            for (auto &entry : m_magazines[location]) {
+                if (!cacheable(entry.first->numBytes) || entry.second.buffers.size() > m_limits.maxBuffersPerSize ||
+                    m_numBytes > m_limits.maxBytes) {
+                    flushBatch(entry.second, *entry.first, location, entry.second.buffers.size());
+                }
+            }
+            for (auto &entry : m_slotMagazines[location]) {
+                if (!slotsCacheable() || entry.second.buffers.size() > m_limits.maxBuffersPerSize) {
+                    flushSlots(entry.second, *entry.first, location, entry.second.buffers.size());
+                }
+            }
+        }
+    }
+
+    /// Frees the buffers of the magazines that have not been used since expiryTime. Buffers pinned by a
+    /// reservation are handed back to the global queue instead, slots to their arenas.
+    void releaseExpired(double expiryTime) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        for (ContainerLocation location = LocationHost; location < LocationINVALID;
+             location = static_cast<ContainerLocation>(location + 1)) {
+            for (auto &entry : m_magazines[location]) {
+                Magazine &magazine = entry.second;
+                if (magazine.buffers.empty() || magazine.lastUseTime >= expiryTime) {
+                    continue;
+                }
+                SizeClass &sizeClass = *entry.first;
+                for (uint8_t *buffer : magazine.buffers) {
+                    if (sizeClass.counters.getCachedBytes() <= sizeClass.numPinned * sizeClass.numBytes) {
+                        pushToQueue(sizeClass, location, &buffer, 1);
+                    } else {
+                        freeCachedBuffer(buffer, sizeClass, location);
+                    }
+                }
+                m_numBytes -= magazine.buffers.size() * sizeClass.numBytes;
+                magazine.buffers.clear();
+            }
+            for (auto &entry : m_slotMagazines[location]) {
+                if (entry.second.lastUseTime < expiryTime) {
+                    flushSlots(entry.second, *entry.first, location, entry.second.buffers.size());
+                }
+            }
+        }
+    }
+
+    /// Hands whole magazines of the given location back to the global queues, until at least numBytes have been
+    /// handed back or the cache is empty. Returns the number of bytes handed back. All slots go back to their
+    /// arenas, so empty arenas can be released.
+    size_t drain(size_t numBytes, ContainerLocation location) {
+        std::lock_guard<std::mutex> cacheLock(m_mutex);
+        for (auto &entry : m_slotMagazines[location]) {
+            flushSlots(entry.second, *entry.first, location, entry.second.buffers.size());
+        }
+        size_t numBytesDrained = 0;
+        for (auto &entry : m_magazines[location]) {
+            if (numBytesDrained >= numBytes) {
+                break;
+            }
+            numBytesDrained += entry.second.buffers.size() * entry.first->numBytes;
+            flushBatch(entry.second, *entry.first, location, entry.second.buffers.size());
+        }
+        return numBytesDrained;
+    }
+
+  private:
+    struct Magazine {
+        std::vector<uint8_t *> buffers;
+        /// Time a buffer was last put into the magazine
+        double lastUseTime = 0;
+    };
+
+    bool cacheable(size_t numBytes) const {
+        return m_limits.maxBuffersPerSize > 0 && m_limits.batchSize > 0 && numBytes <= m_limits.maxBytes;
+    }
+
+    /// Slots are at most sm_slabMaxThreshold, so they are not counted against maxBytes
+    bool slotsCacheable() const { return m_limits.maxBuffersPerSize > 0 && m_limits.batchSize > 0; }
+
+    /// Returns the count buffers that have been cached the longest to the global queue
+    void flushBatch(Magazine &magazine, SizeClass &sizeClass, ContainerLocation location, size_t count) {
+        count = std::min(count, magazine.buffers.size());
+        if (count > 0) {
+            pushToQueue(sizeClass, location, magazine.buffers.data(), count);
+            magazine.buffers.erase(magazine.buffers.begin(), magazine.buffers.begin() + count);
+            m_numBytes -= count * sizeClass.numBytes;
+        }
+    }
+
+    /// Returns the count slots that have been cached the longest to their arenas
+    void flushSlots(Magazine &magazine, SlabClass &slabClass, ContainerLocation location, size_t count) {
+        count = std::min(count, magazine.buffers.size());
+        if (count > 0) {
+            returnSlabSlots(slabClass, location, magazine.buffers.data(), count);
+            magazine.buffers.erase(magazine.buffers.begin(), magazine.buffers.begin() + count);
+        }
+    }
+
+    std::mutex m_mutex;
+    ThreadCacheLimits m_limits;
+    std::array<std::unordered_map<SizeClass *, Magazine>, LocationINVALID> m_magazines;
+    std::array<std::unordered_map<SlabClass *, Magazine>, LocationINVALID> m_slotMagazines;
+    size_t m_numBytes;
+};
+
 ContainerFactory::ContainerStreamType ContainerFactory::getNextStream() {
     std::lock_guard<std::mutex> streamLock(sm_streamMutex);
     if (sm_streams.size() == 0) {
         initStreams();
     }
 
-    size_t streamIndex = sm_streamIndex;
-    sm_streamIndex = (sm_streamIndex + 1) % sm_numberStreams;
-    return sm_streams[streamIndex];
+    size_t streamIndex = sm_streamIndex;
+    sm_streamIndex = (sm_streamIndex + 1) % sm_numberStreams;
+    return sm_streams[streamIndex];
+}
+
+void ContainerFactory::setSizeClassesPerDoubling(ContainerLocation location, size_t classesPerDoubling) {
+    assert(location < LocationINVALID);
+    if ((classesPerDoubling & (classesPerDoubling - 1)) != 0) {
+        throw std::runtime_error("invalid argument: ContainerFactory: classesPerDoubling has to be a power of two");
+    }
+    sm_sizeClassesPerDoubling[location] = classesPerDoubling;
+}
+
+size_t ContainerFactory::getSizeClassBytes(size_t numBytes, ContainerLocation location) {
+    assert(location < LocationINVALID);
+    size_t classesPerDoubling = sm_sizeClassesPerDoubling[location];
+    if (classesPerDoubling == 0 || numBytes == 0) {
+        return numBytes;
+    }
+
+    // The granularity within [2^k, 2^(k+1)) is 2^k / classesPerDoubling, but never below the minimum granularity
+    size_t highestBit = 0;
+    while ((numBytes >> highestBit) > 1) {
+        highestBit++;
+    }
+    size_t granularity = (static_cast<size_t>(1) << highestBit) / classesPerDoubling;
+    granularity = std::max(granularity, sm_sizeClassMinGranularity);
+    return (numBytes + granularity - 1) & ~(granularity - 1);
+}
+
+size_t ContainerFactory::getWastedBytes(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    return sm_locationCounters[location].getWastedBytes();
+}
+
+uint8_t *ContainerFactory::acquireMemory(size_t numBytesRequested, ContainerLocation location,
+                                         ContainerAllocation &allocation) {
+    assert(location < LocationINVALID);
+    if (allocation.maxNumBytes > 0) {
+        return reserveGrowable(numBytesRequested, location, allocation);
+    }
+    if (allocation.frameArena) {
+        uint8_t *buffer = allocation.frameArena->allocate(numBytesRequested,
+                                                          std::max(allocation.alignment, FrameArena::sm_alignment));
+        if (allocation.zeroed) {
+            zeroMemory(buffer, numBytesRequested, location, allocation);
+        }
+        return buffer;
+    }
+    auto startTime = std::chrono::steady_clock::now();
+
+    numBytesRequested = alignedRequestBytes(numBytesRequested, location, allocation);
+    bool explicitNumaNode = allocation.numaNode != NumaNodeLocal;
+    allocation.numaNode = resolveNumaNode(allocation.numaNode, location);
+    allocation.slab = numBytesRequested > 0 && numBytesRequested <= sm_slabThreshold[location] &&
+                      allocation.alignment <= sm_sizeClassMinGranularity;
+    if (allocation.slab) {
+        uint8_t *buffer = acquireSlabSlot(numBytesRequested, location, allocation.numaNode);
+        if (allocation.zeroed) {
+            zeroMemory(buffer, numBytesRequested, location, allocation);
+        }
+        return buffer;
+    }
+
+    // Requests are served with buffers of their size class, so near-miss sizes can share the same queue.
+    // Buffers on different NUMA nodes are never mixed up.
+    size_t numBytes = getSizeClassBytes(numBytesRequested, location);
+    allocation.sizeClassBytes = numBytes;
+    SizeClass &sizeClass = getSizeClass(numBytes, allocation.numaNode, location);
+    admitMemory(numBytes, location, allocation.name);
+
+    // Check whether this thread or the global queue for this location and size has a buffer left
+    uint8_t *buffer = getThreadCache().pop(sizeClass, location);
+    bool hit = buffer != nullptr;
+
+    // Split a larger idle buffer before allocating a new one, if enabled
+    if (!buffer && sm_buddySplitting[location] && !allocation.longLived &&
+        numBytes >= AllocationBackend::getSystemPageSize()) {
+        buffer = acquireBuddyBlock(numBytes, location, allocation.numaNode);
+    }
+
+    // If the queue did not contain a buffer, allocate a new one
+    if (!buffer) {
+        // Check whether there is enough free space for the requested buffer.
+        size_t memoryFree;
+#ifdef HAVE_CUDA
+        size_t memoryTotal;
+        if (location == LocationGpu || location == LocationBoth) {
+            cudaSafeCall(cudaMemGetInfo(&memoryFree, &memoryTotal));
+            memoryFree = static_cast<size_t>(
+                std::max(static_cast<double>(memoryFree) - (static_cast<double>(memoryTotal) * 0.1), 0.0));
+        } else
+#endif
+        {
+            // For the host memory we just rely on the
+            memoryFree = numBytes;
+        }
+
+        // If not, let the garbage collection thread relase enough unused buffers, starting with the ones that have
+        // been returned the longest time ago. The allocation can only succeed after that, so wait for it.
+        if (memoryFree < numBytes) {
+            requestReclaim(numBytes, location, true);
+        }
+
+        // Keep the memory held by the pool within the budget of this location. This does not need to be
+        // enforced before allocating, so the allocating thread does not wait. The memory limit is a cap though,
+        // so above it the cached buffers are released first, including those in the caches of all threads.
+        size_t budget = std::min(sm_memoryBudget[location], sm_memoryLimit[location]);
+        size_t numBytesHeld = getLiveBytes(location) + getCachedBytes(location) + numBytes;
+        bool aboveLimit = numBytesHeld > sm_memoryLimit[location];
+        if (numBytesHeld > budget) {
+            // Only this buffer's share of the overshoot, concurrent misses would request the rest again
+            requestReclaim(std::min(numBytes, numBytesHeld - budget), location, aboveLimit);
+        }
+
+        // Now that we have made the required memory available, we can allocate the buffer
+        bool zeroed = allocation.zeroed;
+        try {
+            // Buffers that are faulted in by the workers are placed by their first touch, unless they have an
+            // explicit node. They are still pooled with the buffers of the allocating thread's node.
+            bool firstTouch = !explicitNumaNode && (location == LocationHost || location == LocationShared) &&
+                              sm_prefaultPolicy == PrefaultParallel && numBytes >= sm_prefaultThreshold;
+            buffer = allocateMemory(numBytes, location, firstTouch ? NumaNodeLocal : allocation.numaNode, zeroed);
+        } catch (...) {
+            releaseAdmission(numBytes, location);
+            throw;
+        }
+        if (allocation.zeroed && !zeroed) {
+            zeroMemory(buffer, numBytesRequested, location, allocation);
+        }
+        if ((location == LocationHost || location == LocationShared) && sm_prefaultPolicy != PrefaultOff &&
+            numBytes >= sm_prefaultThreshold) {
+            prefault(buffer, numBytes, sm_prefaultPolicy);
+        }
+    } else if (allocation.zeroed) {
+        // Pooled buffers still hold the data of their previous container
+        zeroMemory(buffer, numBytesRequested, location, allocation);
+    }
+    // Only acquires that got a buffer are counted, a failed allocation leaves the counters as they were
+    sm_locationCounters[location].countAcquire(numBytes, numBytes - numBytesRequested, hit);
+    sizeClass.counters.countAcquire(numBytes, numBytes - numBytesRequested, hit);
+
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
+    size_t latencyNanoseconds = static_cast<size_t>(latency.count());
+    size_t latencyBucket = 0;
+    while (latencyBucket + 1 < sm_latencyHistogramSize && (latencyNanoseconds >> (latencyBucket + 1)) > 0) {
+        latencyBucket++;
+    }
+    sm_acquireLatencyHistograms[location][getCounterShard()][latencyBucket].fetch_add(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+void ContainerFactory::returnMemory(uint8_t *pointer, size_t numBytesRequested, ContainerLocation location,
+                                    const ContainerAllocation &allocation) {
+    assert(location < LocationINVALID);
+    if (allocation.frameArena) {
+        allocation.frameArena->containerReleased();
+        return;
+    }
+    if (allocation.mapping) {
+        munmap(allocation.mapping, allocation.mappingBytes);
+        return;
+    }
+    if (allocation.slab) {
+        returnSlabSlot(pointer, numBytesRequested, location, allocation.numaNode);
+        return;
+    }
+    numBytesRequested = alignedRequestBytes(numBytesRequested, location, allocation);
+
+    // Buffers acquired before the size classes changed still belong to their original class
+    size_t numBytes =
+        allocation.sizeClassBytes > 0 ? allocation.sizeClassBytes : getSizeClassBytes(numBytesRequested, location);
+    SizeClass &sizeClass = getSizeClass(numBytes, allocation.numaNode, location);
+    sm_locationCounters[location].countReturn(numBytes, numBytes - numBytesRequested);
+    sizeClass.counters.countReturn(numBytes, numBytes - numBytesRequested);
+    releaseAdmission(numBytes, location);
+
+    // do not free here, just put it back to the thread cache or the queues
+    getThreadCache().push(pointer, sizeClass, location);
+}
+
+void ContainerFactory::setSlabThreshold(ContainerLocation location, size_t numBytes) {
+    assert(location < LocationINVALID);
+    if (numBytes > sm_slabMaxThreshold) {
+        throw std::runtime_error("invalid argument: ContainerFactory: The slab threshold must not exceed " +
+                                 to_string(sm_slabMaxThreshold) + " bytes");
+    }
+    sm_slabThreshold[location] = numBytes;
+}
+
+void ContainerFactory::setBuddySplitting(ContainerLocation location, bool enabled) {
+    assert(location < LocationINVALID);
+    if (location != LocationHost && enabled) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Only host buffers can be split, the pages of "
+                                 "free blocks could not be dropped otherwise");
+    }
+    sm_buddySplitting[location] = enabled;
+}
+
+uint8_t *ContainerFactory::acquireBuddyBlock(size_t numBytes, ContainerLocation location, int numaNode) {
+    size_t pageSize = AllocationBackend::getSystemPageSize();
+    std::lock_guard<std::mutex> buddyLock(sm_buddyMutex);
+
+    // Prefer the smallest fitting free block of a buffer that has been split already
+    auto parent = sm_buddyParents.end();
+    size_t blockBytes = SIZE_MAX;
+    for (auto parentIterator = sm_buddyParents.begin(); parentIterator != sm_buddyParents.end(); parentIterator++) {
+        BuddyParent &candidate = parentIterator->second;
+        if (candidate.location != location || candidate.numaNode != numaNode ||
+            candidate.numBytes / sm_buddyMaxSplitFactor > numBytes) {
+            continue;
+        }
+        auto freeBlock = candidate.freeBlocks.lower_bound(numBytes);
+        if (freeBlock != candidate.freeBlocks.end() && freeBlock->first < blockBytes) {
+            parent = parentIterator;
+            blockBytes = freeBlock->first;
+        }
+    }
+
+    if (parent == sm_buddyParents.end()) {
+        // Otherwise take the smallest idle buffer that is at least twice as large, but leave the pinned ones
+        SizeClass *source = nullptr;
+        for (auto &entry : sm_bufferMaps[location]) {
+            SizeClass &sizeClass = entry.second;
+            if (sizeClass.numaNode == numaNode && sizeClass.numBytes >= 2 * numBytes &&
+                sizeClass.numBytes / sm_buddyMaxSplitFactor <= numBytes &&
+                sizeClass.counters.getCachedBytes() > sizeClass.numPinned * sizeClass.numBytes &&
+                (!source || sizeClass.numBytes < source->numBytes)) {
+                source = &sizeClass;
+            }
+        }
+        uint8_t *buffer;
+        if (!source || popFromQueue(*source, &buffer, 1) == 0) {
+            return nullptr;
+        }
+        auto block = sm_buddyBlocks.find(buffer);
+        if (block == sm_buddyBlocks.end() && pagesLocked(buffer)) {
+            // The pages of its free blocks could never be dropped
+            pushToQueue(*source, location, &buffer, 1);
+            return nullptr;
+        }
+        // Its bytes now belong to the free blocks, which are cached as well
+        sm_locationCounters[location].removeCachedBytes(source->numBytes);
+        source->counters.removeCachedBytes(source->numBytes);
+
+        if (block != sm_buddyBlocks.end()) {
+            // The idle buffer is a block itself, give it back to its parent and split that
+            parent = sm_buddyParents.find(block->second.parent);
+            parent->second.numUsedBlocks--;
+            insertBuddyBlock(parent->second, static_cast<size_t>(buffer - parent->first), block->second.numBytes,
+                             block->second.numBytes, getCurrentTime());
+            sm_buddyBlocks.erase(block);
+        } else {
+            parent = sm_buddyParents.emplace(buffer, BuddyParent{location, numaNode, source->numBytes, {}, 0}).first;
+            insertBuddyBlock(parent->second, 0, source->numBytes, source->numBytes, getCurrentTime());
+        }
+        blockBytes = parent->second.freeBlocks.lower_bound(numBytes)->first;
+    }
+
+    // Halve the block as long as the request fits, keeping the blocks page aligned. The halves keep the free time
+    // of the block, so splitting does not postpone their expiry. Which part of a partly dropped block is still
+    // resident is not known, so each half is assumed to hold half of it.
+    BuddyParent &buddyParent = parent->second;
+    auto freeBlocks = buddyParent.freeBlocks.find(blockBytes);
+    size_t offset = freeBlocks->second.begin()->first;
+    FreeBuddyBlock freeBlock = freeBlocks->second.begin()->second;
+    freeBlocks->second.erase(freeBlocks->second.begin());
+    if (freeBlocks->second.empty()) {
+        buddyParent.freeBlocks.erase(freeBlocks);
+    }
+    sm_locationCounters[location].removeCachedBytes(freeBlock.residentBytes);
+    while (blockBytes / 2 >= numBytes && (blockBytes / 2) % pageSize == 0) {
+        blockBytes /= 2;
+        size_t halfResidentBytes = freeBlock.residentBytes / 2;
+        freeBlock.residentBytes -= halfResidentBytes;
+        insertBuddyBlock(buddyParent, offset + blockBytes, blockBytes, halfResidentBytes, freeBlock.freeTime);
+    }
+    buddyParent.numUsedBlocks++;
+
+    uint8_t *block = parent->first + offset;
+    sm_buddyBlocks[block] = BuddyBlock{parent->first, blockBytes};
+    return block;
+}
+
+void ContainerFactory::insertBuddyBlock(BuddyParent &parent, size_t offset, size_t blockBytes, size_t residentBytes,
+                                        double freeTime) {
+    // Requires sm_buddyMutex. The resident bytes of free blocks are cached. Merges the block with its buddy as long
+    // as that is free as well, the merged block is as old as the older one, so that a block that is reused
+    // regularly does not keep its idle buddy from expiring.
+    sm_locationCounters[parent.location].addCachedBytes(residentBytes);
+    while (blockBytes < parent.numBytes) {
+        size_t buddyOffset = (offset / blockBytes) % 2 == 0 ? offset + blockBytes : offset - blockBytes;
+        auto freeBlocks = parent.freeBlocks.find(blockBytes);
+        if (freeBlocks == parent.freeBlocks.end()) {
+            break;
+        }
+        auto buddy = freeBlocks->second.find(buddyOffset);
+        if (buddy == freeBlocks->second.end()) {
+            break;
+        }
+        residentBytes += buddy->second.residentBytes;
+        freeTime = std::min(freeTime, buddy->second.freeTime);
+        freeBlocks->second.erase(buddy);
+        if (freeBlocks->second.empty()) {
+            parent.freeBlocks.erase(freeBlocks);
+        }
+        offset = std::min(offset, buddyOffset);
+        blockBytes *= 2;
+    }
+    parent.freeBlocks[blockBytes][offset] = FreeBuddyBlock{freeTime, residentBytes};
+}
+
+bool ContainerFactory::releaseBuddyBlock(uint8_t *pointer) {
+    uint8_t *parentPointer;
+    BuddyParent parent;
+    {
+        std::lock_guard<std::mutex> buddyLock(sm_buddyMutex);
+        auto block = sm_buddyBlocks.find(pointer);
+        if (block == sm_buddyBlocks.end()) {
+            return false;
+        }
+        auto parentIterator = sm_buddyParents.find(block->second.parent);
+        // The pool frees the block, so its pages are dropped right away, unless the whole buffer is freed anyway
+        size_t residentBytes = block->second.numBytes;
+        if (parentIterator->second.numUsedBlocks > 1 &&
+            madvise(pointer, block->second.numBytes, MADV_DONTNEED) == 0) {
+            residentBytes = 0;
+        }
+        insertBuddyBlock(parentIterator->second, static_cast<size_t>(pointer - parentIterator->first),
+                         block->second.numBytes, residentBytes, getCurrentTime());
+        sm_buddyBlocks.erase(block);
+        if (--parentIterator->second.numUsedBlocks > 0) {
+            return true;
+        }
+        parentPointer = parentIterator->first;
+        parent = std::move(parentIterator->second);
+        sm_buddyParents.erase(parentIterator);
+    }
+    sm_locationCounters[parent.location].removeCachedBytes(
+        parent.freeBlocks.begin()->second.begin()->second.residentBytes);
+
+    // All blocks have coalesced again, so the buffer is released as a whole
+    freeMemory(parentPointer, parent.numBytes, parent.location);
+    return true;
+}
+
+size_t ContainerFactory::discardBuddyBlocks(ContainerLocation location, size_t numBytesMin, double freeTimeMax) {
+    // Drops the pages of free blocks that have been free since before freeTimeMax, until at least numBytesMin have
+    // been given back. The blocks stay free, they are faulted in again when they are used. Page-locked buffers are
+    // never split, so this only fails if the pages have been locked otherwise, and then the blocks stay cached.
+    std::lock_guard<std::mutex> buddyLock(sm_buddyMutex);
+    size_t numBytesDiscarded = 0;
+    for (auto &parent : sm_buddyParents) {
+        if (parent.second.location != location) {
+            continue;
+        }
+        for (auto &freeBlocks : parent.second.freeBlocks) {
+            for (auto &freeBlock : freeBlocks.second) {
+                if (numBytesDiscarded >= numBytesMin) {
+                    return numBytesDiscarded;
+                }
+                FreeBuddyBlock &block = freeBlock.second;
+                if (block.residentBytes > 0 && block.freeTime < freeTimeMax &&
+                    madvise(parent.first + freeBlock.first, freeBlocks.first, MADV_DONTNEED) == 0) {
+                    sm_locationCounters[location].removeCachedBytes(block.residentBytes);
+                    numBytesDiscarded += block.residentBytes;
+                    block.residentBytes = 0;
+                }
+            }
+        }
+    }
+    return numBytesDiscarded;
+}
+
+bool ContainerFactory::pagesLocked(const uint8_t *buffer) {
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    auto allocationIterator = sm_allocations.find(buffer);
+    return allocationIterator == sm_allocations.end() || allocationIterator->second.backend->pagesLocked();
+}
+
+uint8_t *ContainerFactory::acquireSlabSlot(size_t numBytes, ContainerLocation location, int numaNode) {
+    size_t slotBytes = (numBytes + sm_sizeClassMinGranularity - 1) & ~(sm_sizeClassMinGranularity - 1);
+    SlabClass &slabClass = getSlabClass(slotBytes, numaNode, location);
+    // Slots are cached per thread like the buffers, so only refills take the lock of the slab class
+    uint8_t *slot = getThreadCache().popSlot(slabClass, location);
+    if (slot) {
+        return slot;
+    }
+
+    // All arenas are full, get a new one from the pool without holding the lock, as that might have to wait for
+    // a reclaim. If another thread does the same concurrently, its arena is simply used later.
+    ContainerAllocation arenaAllocation;
+    arenaAllocation.numaNode = numaNode;
+    arenaAllocation.longLived = true;
+    uint8_t *buffer = acquireMemory(sm_slabArenaBytes, location, arenaAllocation);
+    uintptr_t firstSlot = (reinterpret_cast<uintptr_t>(buffer) + sm_sizeClassMinGranularity - 1) &
+                          ~(sm_sizeClassMinGranularity - 1);
+
+    std::lock_guard<std::mutex> slabLock(slabClass.mutex);
+    slabClass.arenas[buffer] =
+        SlabArena{reinterpret_cast<uint8_t *>(firstSlot), 0, 0, {}, arenaAllocation.sizeClassBytes, 0};
+    slabClass.availableArenas.insert(buffer);
+    return takeSlabSlot(slabClass);
+}
+
+size_t ContainerFactory::takeSlabSlots(SlabClass &slabClass, uint8_t **slots, size_t maxCount) {
+    std::lock_guard<std::mutex> slabLock(slabClass.mutex);
+    size_t count = 0;
+    while (count < maxCount && !slabClass.availableArenas.empty()) {
+        slots[count] = takeSlabSlot(slabClass);
+        count++;
+    }
+    return count;
+}
+
+uint8_t *ContainerFactory::takeSlabSlot(SlabClass &slabClass) {
+    uint8_t *buffer = *slabClass.availableArenas.begin();
+    SlabArena &arena = slabClass.arenas[buffer];
+
+    uint8_t *slot;
+    if (!arena.freeSlots.empty()) {
+        slot = arena.freeSlots.back();
+        arena.freeSlots.pop_back();
+    } else {
+        slot = arena.firstSlot + arena.numCarved * slabClass.slotBytes;
+        arena.numCarved++;
+    }
+    arena.numUsed++;
+    if (arena.numUsed == slabClass.slotsPerArena) {
+        slabClass.availableArenas.erase(buffer);
+    }
+    return slot;
+}
+
+void ContainerFactory::returnSlabSlot(uint8_t *pointer, size_t numBytes, ContainerLocation location, int numaNode) {
+    size_t slotBytes = (numBytes + sm_sizeClassMinGranularity - 1) & ~(sm_sizeClassMinGranularity - 1);
+    getThreadCache().pushSlot(pointer, getSlabClass(slotBytes, numaNode, location), location);
+}
+
+void ContainerFactory::returnSlabSlots(SlabClass &slabClass, ContainerLocation location, uint8_t *const *slots,
+                                       size_t count) {
+    std::lock_guard<std::mutex> slabLock(slabClass.mutex);
+    for (size_t k = 0; k < count; k++) {
+        auto arenaIterator = slabClass.arenas.upper_bound(slots[k]);
+        assert(arenaIterator != slabClass.arenas.begin());
+        arenaIterator--;
+        uint8_t *buffer = arenaIterator->first;
+        SlabArena &arena = arenaIterator->second;
+
+        if (arena.numUsed == slabClass.slotsPerArena) {
+            slabClass.availableArenas.insert(buffer);
+        }
+        arena.numUsed--;
+        if (arena.numUsed > 0) {
+            arena.freeSlots.push_back(slots[k]);
+        } else if (slabClass.availableArenas.size() > 1) {
+            // Keep at most one empty arena per slab, the others go back to the pool
+            slabClass.availableArenas.erase(buffer);
+            returnSlabArena(buffer, arena.bufferBytes, slabClass.numaNode, location);
+            slabClass.arenas.erase(arenaIterator);
+        } else {
+            // Until it expires, see releaseEmptySlabArenas
+            arena.numCarved = 0;
+            arena.freeSlots.clear();
+            arena.emptyTime = getCurrentTime();
+        }
+    }
+}
+
+void ContainerFactory::returnSlabArena(uint8_t *buffer, size_t numBytes, int numaNode, ContainerLocation location) {
+    // Same as returnMemory, but straight to the global queue, as the caller might hold the lock of a thread cache
+    SizeClass &sizeClass = getSizeClass(numBytes, numaNode, location);
+    sm_locationCounters[location].countReturn(numBytes, numBytes - sm_slabArenaBytes);
+    sizeClass.counters.countReturn(numBytes, numBytes - sm_slabArenaBytes);
+    releaseAdmission(numBytes, location);
+    pushToQueue(sizeClass, location, &buffer, 1);
+}
+
+void ContainerFactory::releaseEmptySlabArenas(ContainerLocation location, double emptyTimeMax) {
+    for (auto &entry : sm_slabMaps[location]) {
+        SlabClass &slabClass = entry.second;
+        std::lock_guard<std::mutex> slabLock(slabClass.mutex);
+        for (auto arenaIterator = slabClass.arenas.begin(); arenaIterator != slabClass.arenas.end();) {
+            SlabArena &arena = arenaIterator->second;
+            if (arena.numUsed == 0 && arena.emptyTime < emptyTimeMax) {
+                slabClass.availableArenas.erase(arenaIterator->first);
+                returnSlabArena(arenaIterator->first, arena.bufferBytes, slabClass.numaNode, location);
+                arenaIterator = slabClass.arenas.erase(arenaIterator);
+            } else {
+                arenaIterator++;
+            }
+        }
+    }
+}
+
+uint8_t *ContainerFactory::reserveGrowable(size_t numBytes, ContainerLocation location,
+                                           ContainerAllocation &allocation) {
+    if (location != LocationHost || numBytes > allocation.maxNumBytes) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Growable buffers have to be in LocationHost and "
+                                 "must not start above their maximum size");
+    }
+    // Reserving only costs address space, MAP_NORESERVE keeps it from counting against the overcommit limit
+    size_t pageSize = AllocationBackend::getSystemPageSize();
+    size_t length = (allocation.maxNumBytes + pageSize - 1) & ~(pageSize - 1);
+    void *mapping = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("bad alloc: ContainerFactory: Could not reserve " + to_string(length) + " bytes");
+    }
+
+    allocation.mapping = reinterpret_cast<uint8_t *>(mapping);
+    allocation.mappingBytes = length;
+    allocation.committedBytes = 0;
+    growMemory(numBytes, allocation);
+    return allocation.mapping;
+}
+
+void ContainerFactory::growMemory(size_t numBytes, ContainerAllocation &allocation) {
+    assert(allocation.maxNumBytes > 0 && allocation.mapping);
+    if (numBytes > allocation.maxNumBytes) {
+        throw std::runtime_error("bad alloc: ContainerFactory: Growable buffer cannot grow to " + to_string(numBytes) +
+                                 " bytes, its maximum is " + to_string(allocation.maxNumBytes));
+    }
+    // Commit in chunks, so appending element by element does not call mprotect every page
+    size_t chunkBytes = std::max(AllocationBackend::getSystemPageSize(), static_cast<size_t>(64 * 1024));
+    if (numBytes <= allocation.committedBytes) {
+        return;
+    }
+    size_t committedBytes = std::min((numBytes + chunkBytes - 1) / chunkBytes * chunkBytes, allocation.mappingBytes);
+    if (mprotect(allocation.mapping + allocation.committedBytes, committedBytes - allocation.committedBytes,
+                 PROT_READ | PROT_WRITE) != 0) {
+        throw std::runtime_error("bad alloc: ContainerFactory: Could not commit " + to_string(committedBytes) +
+                                 " bytes of a growable buffer");
+    }
+    allocation.committedBytes = committedBytes;
+}
+
+uint8_t *ContainerFactory::mapFile(const std::string &filename, FileMappingMode mode, FileAccessHint hint,
+                                   size_t offset, size_t &numBytes, ContainerAllocation &allocation) {
+    int file = open(filename.c_str(), mode == FileReadWrite ? O_RDWR : O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Could not open " + filename + ": " +
+                                 strerror(errno));
+    }
+    struct stat fileStatus;
+    size_t fileBytes = fstat(file, &fileStatus) == 0 ? static_cast<size_t>(fileStatus.st_size) : 0;
+    if (numBytes == 0 && offset < fileBytes) {
+        numBytes = fileBytes - offset;
+    }
+    if (numBytes == 0 || offset > fileBytes || numBytes > fileBytes - offset) {
+        close(file);
+        throw std::runtime_error("invalid argument: ContainerFactory: " + filename + " has " + to_string(fileBytes) +
+                                 " bytes, cannot map " + to_string(numBytes) + " bytes at offset " +
+                                 to_string(offset));
+    }
+
+    // The mapping has to start at a page boundary
+    size_t pageOffset = offset % AllocationBackend::getSystemPageSize();
+    size_t length = numBytes + pageOffset;
+    int protection = mode == FileReadWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *mapping = mmap(nullptr, length, protection, MAP_SHARED, file, static_cast<off_t>(offset - pageOffset));
+    // The mapping keeps its own reference to the file
+    close(file);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("bad alloc: ContainerFactory: Could not map " + filename + ": " + strerror(errno));
+    }
+
+    static const int advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED};
+    madvise(mapping, length, advice[hint]);
+
+    allocation.mapping = reinterpret_cast<uint8_t *>(mapping);
+    allocation.mappingBytes = length;
+    return allocation.mapping + pageOffset;
+}
+
+SharedMemoryHandle ContainerFactory::getSharedMemoryHandle(const uint8_t *buffer, size_t numBytes) {
+    std::shared_ptr<AllocationBackend> backend;
+    {
+        std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+        auto allocationIterator = sm_allocations.find(buffer);
+        if (allocationIterator != sm_allocations.end() && allocationIterator->second.location == LocationShared) {
+            backend = allocationIterator->second.backend;
+        }
+    }
+    auto sharedMemoryBackend = std::dynamic_pointer_cast<SharedMemoryBackend>(backend);
+    if (!sharedMemoryBackend) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Buffer has not been allocated as shared memory");
+    }
+    return SharedMemoryHandle{getpid(), sharedMemoryBackend->getFileDescriptor(buffer), 0, numBytes};
+}
+
+uint8_t *ContainerFactory::attachSharedMemory(const SharedMemoryHandle &handle, ContainerAllocation &allocation) {
+    std::string filename = "/proc/" + to_string(handle.processId) + "/fd/" + to_string(handle.fileDescriptor);
+    size_t numBytes = handle.numBytes;
+    return mapFile(filename, FileReadWrite, FileAccessNormal, handle.offset, numBytes, allocation);
+}
+
+void ContainerFactory::setMemoryBudget(ContainerLocation location, size_t numBytes) {
+    assert(location < LocationINVALID);
+    sm_memoryBudget[location] = numBytes;
+}
+
+void ContainerFactory::setMemoryLimit(ContainerLocation location, size_t numBytes, double timeout) {
+    assert(location < LocationINVALID);
+    std::lock_guard<std::mutex> admissionLock(sm_admissionMutex);
+    sm_memoryLimit[location] = numBytes;
+    sm_admissionTimeout[location] = timeout;
+    // A raised limit might admit waiting requests
+    sm_admissionCondition.notify_all();
+}
+
+void ContainerFactory::admitMemory(size_t numBytes, ContainerLocation location, const char *name) {
+    if (sm_memoryLimit[location] == SIZE_MAX) {
+        sm_admittedBytes[location] += numBytes;
+        return;
+    }
+
+    std::unique_lock<std::mutex> admissionLock(sm_admissionMutex);
+    size_t limit = sm_memoryLimit[location];
+    if (numBytes > limit) {
+        throw std::runtime_error("bad alloc: ContainerFactory: Request of " + to_string(numBytes) +
+                                 " bytes exceeds the memory limit of " + to_string(limit) + " bytes in " +
+                                 locationName(location));
+    }
+    auto admissible = [numBytes, location]() {
+        return sm_admittedBytes[location] + numBytes <= sm_memoryLimit[location];
+    };
+    if (!admissible()) {
+        // Wait for other containers to return memory. They notify after lowering the admitted bytes, which
+        // cannot slip in between the check and the wait, as notifying takes the mutex.
+        auto startTime = std::chrono::steady_clock::now();
+        bool admitted = true;
+        if (sm_admissionTimeout[location] < 0) {
+            sm_admissionCondition.wait(admissionLock, admissible);
+        } else {
+            admitted = sm_admissionCondition.wait_for(
+                admissionLock, std::chrono::duration<double>(sm_admissionTimeout[location]), admissible);
+        }
+        double waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        AdmissionStatistics &statistics = sm_admissionStatistics[name ? name : ""];
+        statistics.waits++;
+        statistics.timeouts += admitted ? 0 : 1;
+        statistics.waitSeconds += waitSeconds;
+        statistics.maxWaitSeconds = std::max(statistics.maxWaitSeconds, waitSeconds);
+        if (!admitted) {
+            throw std::runtime_error("bad alloc: ContainerFactory: Request of " + to_string(numBytes) + " bytes for " +
+                                     (name ? name : "unnamed container") + " in " + locationName(location) +
+                                     " has not been admitted within " + to_string(waitSeconds) + " seconds");
+        }
+    }
+    sm_admittedBytes[location] += numBytes;
+}
+
+void ContainerFactory::releaseAdmission(size_t numBytes, ContainerLocation location) {
+    sm_admittedBytes[location] -= numBytes;
+    if (sm_memoryLimit[location] != SIZE_MAX) {
+        std::lock_guard<std::mutex> admissionLock(sm_admissionMutex);
+        sm_admissionCondition.notify_all();
+    }
+}
+
+void ContainerFactory::setNameAccounting(bool enabled) { sm_nameAccounting = enabled; }
+
+void ContainerFactory::accountAcquire(size_t numBytes, ContainerAllocation &allocation) {
+    if (!sm_nameAccounting) {
+        return;
+    }
+    // Accounts are never erased, so the pointer stays valid for the return, even from a stream callback
+    std::string name(allocation.name ? allocation.name : "");
+    auto accountIterator = sm_nameAccounts.find(name);
+    if (accountIterator == sm_nameAccounts.end()) {
+        accountIterator =
+            sm_nameAccounts.emplace(std::piecewise_construct, std::forward_as_tuple(name), std::forward_as_tuple())
+                .first;
+    }
+    allocation.nameAccount = &accountIterator->second;
+    allocation.nameAccount->allocations++;
+    accountResize(numBytes, allocation);
+}
+
+void ContainerFactory::accountResize(size_t numBytes, ContainerAllocation &allocation) {
+    // Only the difference to the bytes charged so far is charged
+    NameAccount *account = allocation.nameAccount;
+    if (!account) {
+        return;
+    }
+    size_t live = (account->liveBytes += numBytes - allocation.accountedBytes);
+    size_t peak = account->peakBytes;
+    while (live > peak && !account->peakBytes.compare_exchange_weak(peak, live)) {
+    }
+    allocation.accountedBytes = numBytes;
+}
+
+void ContainerFactory::accountReturn(const ContainerAllocation &allocation) {
+    if (allocation.nameAccount) {
+        allocation.nameAccount->liveBytes -= allocation.accountedBytes;
+    }
+}
+
+std::map<std::string, ContainerFactory::NameStatistics> ContainerFactory::getNameStatistics() {
+    std::map<std::string, NameStatistics> statistics;
+    for (auto &entry : sm_nameAccounts) {
+        statistics[entry.first] =
+            NameStatistics{entry.second.liveBytes, entry.second.allocations, entry.second.peakBytes};
+    }
+    return statistics;
+}
+
+void ContainerFactory::dumpNameStatistics(std::ostream &stream) {
+    auto statistics = getNameStatistics();
+    std::vector<std::pair<std::string, NameStatistics>> accounts(statistics.begin(), statistics.end());
+    std::stable_sort(accounts.begin(), accounts.end(), [](const std::pair<std::string, NameStatistics> &a,
+                                                          const std::pair<std::string, NameStatistics> &b) {
+        return a.second.liveBytes > b.second.liveBytes;
+    });
+    for (auto &account : accounts) {
+        stream << "name " << (account.first.empty() ? "(unnamed)" : account.first) << ": live "
+               << account.second.liveBytes << " B, peak " << account.second.peakBytes << " B, allocations "
+               << account.second.allocations << '\n';
+    }
+}
+
+std::map<std::string, ContainerFactory::AdmissionStatistics> ContainerFactory::getAdmissionStatistics() {
+    std::lock_guard<std::mutex> admissionLock(sm_admissionMutex);
+    return sm_admissionStatistics;
+}
+
+size_t ContainerFactory::getCachedBytes(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    return sm_locationCounters[location].getCachedBytes();
+}
+
+size_t ContainerFactory::getLiveBytes(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    return sm_locationCounters[location].getLiveBytes();
+}
+
+size_t ContainerFactory::getCounterShard() {
+    // Threads take the shards round-robin, so as long as there are no more threads than shards, each has its own
+    static std::atomic<size_t> nextShard(0);
+    thread_local size_t shard = nextShard++ % sm_counterShards;
+    return shard;
+}
+
+void ContainerFactory::Counters::countAcquire(size_t numBytes, size_t numBytesWasted, bool hit) {
+    Shard &shard = shards[getCounterShard()];
+    shard.acquires.fetch_add(1, std::memory_order_relaxed);
+    (hit ? shard.hits : shard.misses).fetch_add(1, std::memory_order_relaxed);
+    if (hit) {
+        shard.cachedBytes.fetch_sub(numBytes, std::memory_order_relaxed);
+    }
+    shard.wastedBytes.fetch_add(numBytesWasted, std::memory_order_relaxed);
+    shard.liveBytes.fetch_add(numBytes, std::memory_order_relaxed);
+    // Summing up the shards is left to the misses, which allocate anyway
+    if (!hit) {
+        sampleLiveBytes();
+    }
+}
+
+void ContainerFactory::Counters::countReturn(size_t numBytes, size_t numBytesWasted) {
+    Shard &shard = shards[getCounterShard()];
+    shard.liveBytes.fetch_sub(numBytes, std::memory_order_relaxed);
+    shard.cachedBytes.fetch_add(numBytes, std::memory_order_relaxed);
+    shard.wastedBytes.fetch_sub(numBytesWasted, std::memory_order_relaxed);
 }
 
-uint8_t *ContainerFactory::acquireMemory(size_t numBytes, ContainerLocation location) {
-    assert(location < LocationINVALID);
-    // std::lock_guard<std::mutex> streamLock(sm_memoryMutex);
+void ContainerFactory::Counters::countFree(size_t numBytes) {
+    Shard &shard = shards[getCounterShard()];
+    shard.frees.fetch_add(1, std::memory_order_relaxed);
+    shard.cachedBytes.fetch_sub(numBytes, std::memory_order_relaxed);
+}
+
+void ContainerFactory::Counters::addCachedBytes(size_t numBytes) {
+    shards[getCounterShard()].cachedBytes.fetch_add(numBytes, std::memory_order_relaxed);
+}
+
+void ContainerFactory::Counters::removeCachedBytes(size_t numBytes) {
+    shards[getCounterShard()].cachedBytes.fetch_sub(numBytes, std::memory_order_relaxed);
+}
+
+size_t ContainerFactory::Counters::getLiveBytes() const {
+    size_t live = 0;
+    for (const Shard &shard : shards) {
+        live += shard.liveBytes.load(std::memory_order_relaxed);
+    }
+    return live;
+}
+
+size_t ContainerFactory::Counters::getCachedBytes() const {
+    size_t cached = 0;
+    for (const Shard &shard : shards) {
+        cached += shard.cachedBytes.load(std::memory_order_relaxed);
+    }
+    return cached;
+}
 
-    // Check whether the queue for this location and size has a buffer left
-    uint8_t *buffer = nullptr;
+size_t ContainerFactory::Counters::getWastedBytes() const {
+    size_t wasted = 0;
+    for (const Shard &shard : shards) {
+        wasted += shard.wastedBytes.load(std::memory_order_relaxed);
+    }
+    return wasted;
+}
+
+size_t ContainerFactory::Counters::sampleLiveBytes() {
+    size_t live = getLiveBytes();
+    size_t highWater = highWaterBytes;
+    while (live > highWater && !highWaterBytes.compare_exchange_weak(highWater, live)) {
+    }
+    return live;
+}
+
+ContainerFactory::Statistics ContainerFactory::Counters::snapshot() {
+    Statistics statistics{0, 0, 0, 0, sampleLiveBytes(), getCachedBytes(), getWastedBytes(), highWaterBytes};
+    for (const Shard &shard : shards) {
+        statistics.acquires += shard.acquires.load(std::memory_order_relaxed);
+        statistics.hits += shard.hits.load(std::memory_order_relaxed);
+        statistics.misses += shard.misses.load(std::memory_order_relaxed);
+        statistics.frees += shard.frees.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
+
+ContainerFactory::LocationStatistics ContainerFactory::getStatistics(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    LocationStatistics statistics;
+    statistics.total = sm_locationCounters[location].snapshot();
+    for (auto &entry : sm_bufferMaps[location]) {
+        statistics.sizeClasses[entry.first] = entry.second.counters.snapshot();
+    }
+    statistics.acquireLatencyHistogram.fill(0);
+    for (const LatencyHistogram &histogram : sm_acquireLatencyHistograms[location]) {
+        for (size_t k = 0; k < sm_latencyHistogramSize; k++) {
+            statistics.acquireLatencyHistogram[k] += histogram[k].load(std::memory_order_relaxed);
+        }
+    }
+    for (auto &entry : sm_slabMaps[location]) {
+        SlabClass &slabClass = entry.second;
+        std::lock_guard<std::mutex> slabLock(slabClass.mutex);
+        SlabStatistics &slabStatistics = statistics.slabClasses[entry.first];
+        slabStatistics = SlabStatistics{slabClass.arenas.size(), slabClass.slotsPerArena, 0};
+        for (auto &arena : slabClass.arenas) {
+            slabStatistics.usedSlots += arena.second.numUsed;
+        }
+    }
+    statistics.buddyParents = 0;
+    statistics.buddyFreeBytes = 0;
+    statistics.buddyResidentBytes = 0;
     {
-        // by directly accessing the desired length in the map sm_bufferMaps[location],
-        // the map entry is created if it does not already exist. That means the map is
-        // modified here
-        std::lock_guard<std::mutex> streamLock(sm_memoryMutex);
+        std::lock_guard<std::mutex> buddyLock(sm_buddyMutex);
+        for (auto &entry : sm_buddyParents) {
+            if (entry.second.location == location) {
+                statistics.buddyParents++;
+                for (auto &freeBlocks : entry.second.freeBlocks) {
+                    statistics.buddyFreeBytes += freeBlocks.first * freeBlocks.second.size();
+                    for (auto &freeBlock : freeBlocks.second) {
+                        statistics.buddyResidentBytes += freeBlock.second.residentBytes;
+                    }
+                }
+            }
+        }
+    }
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    for (auto &entry : sm_allocations) {
+        if (entry.second.location == location) {
+            statistics.bytesByPageSize[entry.second.pageSize] += entry.second.numBytes;
+        }
+    }
+    return statistics;
+}
 
-        tbb::concurrent_queue<std::pair<uint8_t *, double>> *queuePointer = &(sm_bufferMaps[location][numBytes]);
+static std::ostream &operator<<(std::ostream &stream, const ContainerFactory::Statistics &statistics) {
+    return stream << "acquires " << statistics.acquires << ", hits " << statistics.hits << ", misses "
+                  << statistics.misses << ", frees " << statistics.frees << ", live " << statistics.liveBytes
+                  << " B, cached " << statistics.cachedBytes << " B, wasted " << statistics.wastedBytes
+                  << " B, high water " << statistics.highWaterBytes << " B";
+}
 
-        std::pair<uint8_t *, double> queueEntry;
-        if (queuePointer->try_pop(queueEntry)) {
-            // If yes, just return this already allocated buffer
-            buffer = queueEntry.first;
+void ContainerFactory::dumpStatistics(std::ostream &stream) {
+    stream << "ContainerFactory statistics " << timeToString(getCurrentTime()) << '\n';
+    for (auto &entry : getAdmissionStatistics()) {
+        stream << "admission " << (entry.first.empty() ? "(unnamed)" : entry.first) << ": waits "
+               << entry.second.waits << ", timeouts " << entry.second.timeouts << ", waited "
+               << entry.second.waitSeconds << " s, longest " << entry.second.maxWaitSeconds << " s\n";
+    }
+    dumpNameStatistics(stream);
+    for (ContainerLocation location = LocationHost; location < LocationINVALID;
+         location = static_cast<ContainerLocation>(location + 1)) {
+        LocationStatistics statistics = getStatistics(location);
+        stream << locationName(location) << ": " << statistics.total << '\n';
+        stream << "  acquire latency [ns]:";
+        for (size_t k = 0; k < sm_latencyHistogramSize; k++) {
+            if (statistics.acquireLatencyHistogram[k] > 0) {
+                stream << " <" << (static_cast<size_t>(2) << k) << ": " << statistics.acquireLatencyHistogram[k];
+            }
+        }
+        stream << '\n';
+        stream << "  allocated bytes by page size:";
+        for (auto &entry : statistics.bytesByPageSize) {
+            stream << ' ' << entry.first << ": " << entry.second;
+        }
+        stream << '\n';
+        for (auto &entry : statistics.sizeClasses) {
+            stream << "  size " << entry.first.first << " node " << entry.first.second << ": " << entry.second << '\n';
+        }
+        for (auto &entry : statistics.slabClasses) {
+            stream << "  slab " << entry.first.first << " node " << entry.first.second << ": arenas "
+                   << entry.second.arenas << ", used slots " << entry.second.usedSlots << " of "
+                   << entry.second.arenas * entry.second.slotsPerArena << '\n';
+        }
+        if (statistics.buddyParents > 0) {
+            stream << "  split buffers: " << statistics.buddyParents << ", free blocks " << statistics.buddyFreeBytes
+                   << " B, resident " << statistics.buddyResidentBytes << " B\n";
         }
     }
+}
 
-    // If the queue did not contain a buffer, allocate a new one
-    if (!buffer) {
-        // Check whether there is enough free space for the requested buffer.
-        size_t memoryFree;
+void ContainerFactory::setStatisticsDumpFile(const std::string &filename, double interval) {
+    std::lock_guard<std::mutex> reclaimLock(sm_reclaimMutex);
+    sm_statisticsDumpFile = filename;
+    sm_statisticsDumpInterval = interval;
+    sm_reclaimRequestedCondition.notify_one();
+}
+
+const char *ContainerFactory::locationName(ContainerLocation location) {
+    switch (location) {
+    case LocationHost:
+        return "LocationHost";
+    case LocationGpu:
+        return "LocationGpu";
+    case LocationBoth:
+        return "LocationBoth";
+    case LocationShared:
+        return "LocationShared";
+    default:
+        return "LocationINVALID";
+    }
+}
+
+void ContainerFactory::reserve(ContainerLocation location, size_t numBytes, size_t count, bool pinned,
+                               int numaNode) {
+    assert(location < LocationINVALID);
+    numaNode = resolveNumaNode(numaNode, location);
+    SizeClass &sizeClass = getSizeClass(getSizeClassBytes(numBytes, location), numaNode, location);
+    numBytes = sizeClass.numBytes;
+
+    std::vector<uint8_t *> buffers(count);
+    for (uint8_t *&buffer : buffers) {
+        bool zeroed = false;
+        buffer = allocateMemory(numBytes, location, numaNode, zeroed);
+        // Touch all pages now, so the first container does not pay for the page faults
 #ifdef HAVE_CUDA
-        size_t memoryTotal;
+        // Managed buffers are touched on the device as well, a memset on the host would migrate them to the host
         if (location == LocationGpu || location == LocationBoth) {
-            cudaSafeCall(cudaMemGetInfo(&memoryFree, &memoryTotal));
-            memoryFree = static_cast<size_t>(
-                std::max(static_cast<double>(memoryFree) - (static_cast<double>(memoryTotal) * 0.1), 0.0));
+            cudaSafeCall(cudaMemset(buffer, 0, numBytes));
         } else
 #endif
-        {
-            // For the host memory we just rely on the
-            memoryFree = numBytes;
+        if (location == LocationHost || location == LocationShared) {
+            prefault(buffer, numBytes, sm_prefaultPolicy != PrefaultOff ? sm_prefaultPolicy : PrefaultPopulate);
+        } else {
+            std::memset(buffer, 0, numBytes);
         }
+    }
 
-        // If not, relase enough unused buffers, starting with the ones that have been returned the longest time ago.
-        if (memoryFree < numBytes) {
-            freeBuffers(numBytes, location);
+    sm_locationCounters[location].addCachedBytes(count * numBytes);
+    sizeClass.counters.addCachedBytes(count * numBytes);
+    if (pinned) {
+        sizeClass.numPinned += count;
+    }
+    pushToQueue(sizeClass, location, buffers.data(), count);
+    LOG(INFO) << "ContainerFactory: Reserved " << count << " buffers of " << numBytes << " bytes in "
+              << locationName(location) << " on node " << numaNode << (pinned ? ", pinned" : "");
+}
+
+bool ContainerFactory::saveWorkingSetProfile(const std::string &filename) {
+    std::ofstream profile(filename);
+    if (!profile.good()) {
+        LOG(ERROR) << "ContainerFactory: Cannot write working set profile " << filename;
+        return false;
+    }
+
+    profile << "# location numBytes numaNode peakBuffers\n";
+    for (ContainerLocation location = LocationHost; location < LocationINVALID;
+         location = static_cast<ContainerLocation>(location + 1)) {
+        for (auto &entry : sm_bufferMaps[location]) {
+            // The live high water mark of a size class is the peak number of its buffers used at the same time
+            size_t peakBuffers = entry.second.counters.snapshot().highWaterBytes / entry.second.numBytes;
+            if (peakBuffers > 0) {
+                profile << locationName(location) << ' ' << entry.second.numBytes << ' ' << entry.second.numaNode << ' '
+                        << peakBuffers << '\n';
+            }
         }
+    }
+    return profile.good();
+}
 
-        // additionaly, release memory that has been returned over XX (e.g. 30) seconds ago
-        freeOldBuffers();
+bool ContainerFactory::loadWorkingSetProfile(const std::string &filename, bool prewarm) {
+    std::ifstream profile(filename);
+    if (!profile.good()) {
+        return false;
+    }
 
-        // Now that we have made the required memory available, we can allocate the buffer
-        buffer = allocateMemory(numBytes, location);
+    std::string line;
+    while (std::getline(profile, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> tokens = split(line, ' ');
+        ContainerLocation location = LocationHost;
+        while (location < LocationINVALID && tokens[0] != locationName(location)) {
+            location = static_cast<ContainerLocation>(location + 1);
+        }
+        // Each number has to be parsed completely, sizes must not be negative
+        size_t numBytes = 0;
+        int numaNode = 0;
+        size_t peakBuffers = 0;
+        auto parse = [](const std::string &token, auto &value) {
+            std::istringstream stream(token);
+            return token.find('-') == std::string::npos && (stream >> value) && stream.eof();
+        };
+        if (tokens.size() != 4 || location == LocationINVALID || !parse(tokens[1], numBytes) ||
+            !parse(tokens[2], numaNode) || !parse(tokens[3], peakBuffers)) {
+            LOG(WARNING) << "ContainerFactory: Ignoring invalid working set profile line '" << line << "'";
+            continue;
+        }
+#ifndef HAVE_CUDA
+        if (location != LocationHost && location != LocationShared) {
+            continue;
+        }
+#endif
+        if (numaNode >= numaNodeCount()) {
+            numaNode = NumaNodeLocal;
+        }
+        if (!prewarm || numBytes == 0 || peakBuffers == 0) {
+            continue;
+        }
+        // A profile of another run or machine must not take the pool beyond its budget or memory limit
+        size_t budget = std::min(sm_memoryBudget[location], sm_memoryLimit[location]);
+        size_t numBytesHeld = getLiveBytes(location) + getCachedBytes(location);
+        size_t maxBuffers = numBytesHeld < budget ? (budget - numBytesHeld) / getSizeClassBytes(numBytes, location) : 0;
+        if (peakBuffers > maxBuffers) {
+            LOG(WARNING) << "ContainerFactory: Reserving only " << maxBuffers << " of " << peakBuffers << " buffers of "
+                         << numBytes << " bytes in " << locationName(location) << " to stay within the budget";
+            peakBuffers = maxBuffers;
+        }
+        if (peakBuffers > 0) {
+            reserve(location, numBytes, peakBuffers, false, numaNode);
+        }
     }
-    return buffer;
+    return true;
 }
 
-void ContainerFactory::returnMemory(uint8_t *pointer, size_t numBytes, ContainerLocation location) {
-    // std::lock_guard<std::mutex> streamLock(sm_memoryMutex);
-    assert(location < LocationINVALID);
+void ContainerFactory::enableWorkingSetProfile(const std::string &filename, bool prewarm) {
+    if (fileExists(filename)) {
+        loadWorkingSetProfile(filename, prewarm);
+    }
+    if (sm_workingSetProfileFile.empty()) {
+        std::atexit(&ContainerFactory::saveWorkingSetProfileAtExit);
+    }
+    sm_workingSetProfileFile = filename;
+}
+
+void ContainerFactory::saveWorkingSetProfileAtExit() { saveWorkingSetProfile(sm_workingSetProfileFile); }
+
+void ContainerFactory::setThreadCacheLimits(const ThreadCacheLimits &limits) { getThreadCache().setLimits(limits); }
+
+void ContainerFactory::setDefaultThreadCacheLimits(const ThreadCacheLimits &limits) {
+    sm_defaultThreadCacheLimits = limits;
+}
+
+void ContainerFactory::flushThreadCache() { getThreadCache().flush(); }
+
+ContainerFactory::ThreadCache &ContainerFactory::getThreadCache() {
+    thread_local ThreadCache threadCache;
+    return threadCache;
+}
+
+void ContainerFactory::releaseExpiredThreadCaches(double expiryTime) {
+    std::lock_guard<std::mutex> registryLock(sm_threadCachesMutex);
+    for (ThreadCache *threadCache : sm_threadCaches) {
+        threadCache->releaseExpired(expiryTime);
+    }
+}
+
+size_t ContainerFactory::drainThreadCaches(size_t numBytes, ContainerLocation location) {
+    std::lock_guard<std::mutex> registryLock(sm_threadCachesMutex);
+    size_t numBytesDrained = 0;
+    for (auto threadCache = sm_threadCaches.begin(); threadCache != sm_threadCaches.end() && numBytesDrained < numBytes;
+         threadCache++) {
+        numBytesDrained += (*threadCache)->drain(numBytes - numBytesDrained, location);
+    }
+    return numBytesDrained;
+}
+
+size_t ContainerFactory::getAlignment(const uint8_t *buffer) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    if (address == 0) {
+        return 0;
+    }
+    return std::min(static_cast<size_t>(address & (~address + 1)), AllocationBackend::getSystemPageSize());
+}
+
+size_t ContainerFactory::alignedRequestBytes(size_t numBytes, ContainerLocation location,
+                                             const ContainerAllocation &allocation) {
+    size_t alignment = allocation.alignment;
+    // Shared buffers are always mapped, so they are page aligned
+    size_t maxAlignment = location == LocationHost || location == LocationShared
+                              ? AllocationBackend::getSystemPageSize()
+                              : sm_deviceAlignment;
+    if ((alignment & (alignment - 1)) != 0 || alignment > maxAlignment) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Unsupported alignment " + to_string(alignment) +
+                                 " in " + locationName(location));
+    }
+    // Only buffers of at least a page are page aligned, so smaller requests for more than the minimum alignment
+    // are served from the smallest of those
+    if (location == LocationHost && alignment > sm_minimumAlignment) {
+        numBytes = std::max(numBytes, AllocationBackend::getSystemPageSize());
+    }
+    return numBytes;
+}
+
+int ContainerFactory::resolveNumaNode(int numaNode, ContainerLocation location) {
+    // Shared buffers are host memory as well and are placed the same way
+    if ((location != LocationHost && location != LocationShared) || numaNodeCount() <= 1) {
+        return 0;
+    }
+    if (numaNode == NumaNodeLocal) {
+        return numaCurrentNode();
+    }
+    if (numaNode != NumaNodeInterleave && (numaNode < 0 || numaNode >= numaNodeCount())) {
+        throw std::runtime_error("invalid argument: ContainerFactory: Unknown NUMA node " + to_string(numaNode));
+    }
+    return numaNode;
+}
+
+ContainerFactory::SizeClass &ContainerFactory::getSizeClass(size_t numBytes, int numaNode,
+                                                            ContainerLocation location) {
+    // Look the size class up first, so the hit path does not touch the map structure. Both find and emplace of
+    // the concurrent map are lock-free and elements are never erased, hence references to them stay valid.
+    // If two threads emplace the same size concurrently, one of them just gets the existing element.
+    auto &bufferMap = sm_bufferMaps[location];
+    SizeClassKey key(numBytes, numaNode);
+    auto mapIterator = bufferMap.find(key);
+    if (mapIterator == bufferMap.end()) {
+        mapIterator =
+            bufferMap.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(key)).first;
+    }
+    return mapIterator->second;
+}
 
-    // do not free here, just put it back to the queues with the time it was returned at
+ContainerFactory::SlabClass &ContainerFactory::getSlabClass(size_t slotBytes, int numaNode,
+                                                            ContainerLocation location) {
+    // Same as getSizeClass, slab classes are never erased
+    auto &slabMap = sm_slabMaps[location];
+    SizeClassKey key(slotBytes, numaNode);
+    auto mapIterator = slabMap.find(key);
+    if (mapIterator == slabMap.end()) {
+        mapIterator =
+            slabMap.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(key)).first;
+    }
+    return mapIterator->second;
+}
+
+bool ContainerFactory::claimCachedBuffer(CachedBuffer *entry) { return !entry->claimed.exchange(true); }
+
+void ContainerFactory::releaseCachedBuffer(CachedBuffer *entry) {
+    if (entry->references.fetch_sub(1) == 1) {
+        delete entry;
+    }
+}
+
+size_t ContainerFactory::popFromQueue(SizeClass &sizeClass, uint8_t **buffers, size_t maxCount) {
+    BufferQueue &queue = sizeClass.queue;
+
+    size_t count = 0;
+    CachedBuffer *entry;
+    while (count < maxCount && queue.try_pop(entry)) {
+        // Entries that have already been evicted are just dropped
+        if (claimCachedBuffer(entry)) {
+            buffers[count] = entry->pointer;
+            count++;
+        }
+        releaseCachedBuffer(entry);
+    }
+    return count;
+}
+
+void ContainerFactory::pushToQueue(SizeClass &sizeClass, ContainerLocation location, uint8_t *const *buffers,
+                                   size_t count) {
+    // Put the buffers back to the queue with the time they were returned at
     double returnTime = getCurrentTime();
 
-    // Put buffer back to queue
-    {
-        std::lock_guard<std::mutex> streamLock(sm_memoryMutex);
-        tbb::concurrent_queue<std::pair<uint8_t *, double>> *queuePointer = &(sm_bufferMaps[location][numBytes]);
-        queuePointer->push(std::make_pair(pointer, returnTime));
+    BufferQueue &queue = sizeClass.queue;
+    for (size_t k = 0; k < count; k++) {
+        CachedBuffer *entry = new CachedBuffer{buffers[k], &sizeClass, returnTime, {false}, {2}};
+        queue.push(entry);
+        sm_recencyQueues[location].push(entry);
+    }
+}
+
+ContainerFactory::CachedBuffer *ContainerFactory::peekLeastRecentlyReturned(ContainerLocation location) {
+    // Requires sm_evictionMutex. Entries that have been reused in the meantime are dropped on the way.
+    CachedBuffer *&front = sm_recencyFront[location];
+    while (front || sm_recencyQueues[location].try_pop(front)) {
+        if (!front->claimed) {
+            return front;
+        }
+        releaseCachedBuffer(front);
+        front = nullptr;
+    }
+    return nullptr;
+}
+
+void ContainerFactory::popLeastRecentlyReturned(ContainerLocation location) {
+    // Requires sm_evictionMutex
+    releaseCachedBuffer(sm_recencyFront[location]);
+    sm_recencyFront[location] = nullptr;
+}
+
+void ContainerFactory::freeCachedBuffer(uint8_t *pointer, SizeClass &sizeClass, ContainerLocation location) {
+    // Requires the buffer to be claimed. Releasing a pinned buffer drops its pin, otherwise the reservation would
+    // pin the next buffer returned to the size class instead.
+    size_t numPinned = sizeClass.numPinned;
+    while (numPinned > 0 && sizeClass.counters.getCachedBytes() <= numPinned * sizeClass.numBytes &&
+           !sizeClass.numPinned.compare_exchange_weak(numPinned, numPinned - 1)) {
+    }
+    freeMemory(pointer, sizeClass.numBytes, location);
+    sm_locationCounters[location].countFree(sizeClass.numBytes);
+    sizeClass.counters.countFree(sizeClass.numBytes);
+}
+
+size_t ContainerFactory::evictLeastRecentlyReturned(size_t numBytesMin, ContainerLocation location) {
+    std::lock_guard<std::mutex> evictionLock(sm_evictionMutex);
+
+    // The free blocks of split buffers go first, their pages can be dropped without freeing any buffer
+    size_t numBytesFreed = discardBuddyBlocks(location, numBytesMin, std::numeric_limits<double>::infinity());
+    bool drained = false;
+    while (numBytesFreed < numBytesMin) {
+        CachedBuffer *entry = peekLeastRecentlyReturned(location);
+        if (!entry) {
+            // The buffers held back by the thread caches and the empty slab arenas go last, they are the most
+            // likely to be reused soon
+            if (drained) {
+                break;
+            }
+            drainThreadCaches(numBytesMin - numBytesFreed, location);
+            releaseEmptySlabArenas(location, std::numeric_limits<double>::infinity());
+            drained = true;
+            continue;
+        }
+        if (claimCachedBuffer(entry)) {
+            freeCachedBuffer(entry->pointer, *entry->sizeClass, location);
+            numBytesFreed += entry->sizeClass->numBytes;
+        }
+        popLeastRecentlyReturned(location);
     }
+    return numBytesFreed;
 }
+
 void ContainerFactory::initStreams() {
     LOG(INFO) << "ContainerFactory: Initializing " << sm_numberStreams << " streams.";
     sm_streamIndex = 0;
@@ -110,129 +1553,383 @@ void ContainerFactory::initStreams() {
 #endif
 }
 
-uint8_t *ContainerFactory::allocateMemory(size_t numBytes, ContainerLocation location) {
-    uint8_t *buffer = nullptr;
-    switch (location) {
-    case LocationGpu:
-#ifdef HAVE_CUDA
-        cudaSafeCall(cudaMalloc((void **)&buffer, numBytes));
-#endif
-        break;
-    case LocationBoth:
-#ifdef HAVE_CUDA
-        cudaSafeCall(cudaMallocManaged((void **)&buffer, numBytes));
-#endif
-        break;
-    case LocationHost:
-#ifdef HAVE_CUDA
-        cudaSafeCall(cudaMallocHost((void **)&buffer, numBytes));
-#else
-        buffer = new uint8_t[numBytes];
-#endif
-        break;
-    default:
-        throw std::runtime_error("invalid argument: Container: Unknown location given");
+uint8_t *ContainerFactory::allocateMemory(size_t numBytes, ContainerLocation location, int numaNode, bool &zeroed) {
+    std::shared_ptr<AllocationBackend> backend = getAllocationBackend(location);
+    AllocationBackend::Block block{nullptr, numBytes, AllocationBackend::getSystemPageSize(), 0, zeroed};
+    backend->allocate(block, numaNode);
+    if (!block.pointer && getCachedBytes(location) > 0) {
+        // Idle buffers might be all that is in the way, release them and try again once
+        LOG(WARNING) << "ContainerFactory: Allocating " << numBytes << " bytes in " << locationName(location)
+                     << " failed, releasing " << getCachedBytes(location) << " cached bytes";
+        releaseCachedBuffers(location);
+        block = AllocationBackend::Block{nullptr, numBytes, AllocationBackend::getSystemPageSize(), 0, zeroed};
+        backend->allocate(block, numaNode);
     }
-    if (!buffer) {
+    if (!block.pointer) {
         std::stringstream s;
         s << "bad alloc: Container: Error allocating buffer of size " << numBytes << " in "
-          << (location == LocationHost ? "LocationHost" : (location == LocationGpu ? "LocationGpu" : "LocationBoth"));
+          << locationName(location) << " with backend " << backend->getName();
         throw std::runtime_error(s.str());
     }
-    return buffer;
+
+    zeroed = block.zeroed;
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    sm_allocations[block.pointer] = Allocation{location, backend, numBytes, block.pageSize, block.mappedBytes};
+    return block.pointer;
 }
 
-void ContainerFactory::freeBuffers(size_t numBytesMin, ContainerLocation location) {
-    size_t numBytesFreed = 0;
-    size_t numBuffersFreed;
-    do {
-        numBuffersFreed = 0;
-        // by traversing the map sm_bufferMaps[location] we never create new entries, but only modifiy those already
-        // present.
-        for (auto mapIterator = sm_bufferMaps[location].begin(); mapIterator != sm_bufferMaps[location].end();
-             mapIterator++) {
-            size_t numBytesBuffer = mapIterator->first;
-            std::pair<uint8_t *, double> queueEntry;
-            if (mapIterator->second.try_pop(queueEntry)) {
-                // If there is an element in this queue, remove it and free the memory
-                freeMemory(queueEntry.first, numBytesBuffer, location);
-                numBytesFreed += numBytesBuffer;
-                numBuffersFreed++;
-            }
+void ContainerFactory::zeroMemory(uint8_t *buffer, size_t numBytes, [[maybe_unused]] ContainerLocation location,
+                                  [[maybe_unused]] const ContainerAllocation &allocation) {
+#ifdef HAVE_CUDA
+    // The container streams do not synchronize with the legacy default stream, so the buffer is cleared on the
+    // stream of the container, before anything the container enqueues
+    if (location == LocationGpu || location == LocationBoth) {
+        cudaSafeCall(cudaMemsetAsync(buffer, 0, numBytes, allocation.stream));
+        return;
+    }
+#endif
+    if (numBytes < sm_parallelZeroThreshold) {
+        std::memset(buffer, 0, numBytes);
+        return;
+    }
+    // Chunks of a megabyte amortize the task overhead and keep the stores streaming
+    size_t chunkBytes = 1024 * 1024;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, (numBytes + chunkBytes - 1) / chunkBytes),
+                      [buffer, numBytes, chunkBytes](const tbb::blocked_range<size_t> &chunks) {
+                          size_t begin = chunks.begin() * chunkBytes;
+                          size_t end = std::min(chunks.end() * chunkBytes, numBytes);
+                          std::memset(buffer + begin, 0, end - begin);
+                      });
+}
+
+void ContainerFactory::setPrefaultPolicy(PrefaultPolicy policy, size_t thresholdBytes) {
+    sm_prefaultPolicy = policy;
+    sm_prefaultThreshold = thresholdBytes;
+}
+
+ContainerFactory::PrefaultPolicy ContainerFactory::getPrefaultPolicy() { return sm_prefaultPolicy; }
+
+void ContainerFactory::prefault(uint8_t *buffer, size_t numBytes, PrefaultPolicy policy) {
+    // Buffers advised to use huge pages might still be backed by small ones, so every small page is touched
+    size_t pageSize = AllocationBackend::getSystemPageSize();
+    size_t numPages = (numBytes + pageSize - 1) / pageSize;
+    // Writing one byte per page is enough to fault it in, the buffer has no defined content yet
+    auto touchPages = [buffer, pageSize](const tbb::blocked_range<size_t> &pages) {
+        volatile uint8_t *pointer = buffer;
+        for (size_t page = pages.begin(); page != pages.end(); page++) {
+            pointer[page * pageSize] = 0;
         }
-    } while (numBytesFreed < numBytesMin && numBuffersFreed > 0);
+    };
+
+    if (policy == PrefaultParallel) {
+        // Chunks of at least a megabyte amortize the task overhead
+        size_t grainSize = std::max(static_cast<size_t>(1), (1024 * 1024) / pageSize);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, numPages, grainSize), touchPages);
+        return;
+    }
+
+#ifdef MADV_POPULATE_WRITE
+    // madvise needs a page aligned start, populating the neighbouring part of the first page does no harm
+    uintptr_t start = reinterpret_cast<uintptr_t>(buffer) & ~(AllocationBackend::getSystemPageSize() - 1);
+    if (madvise(reinterpret_cast<void *>(start), reinterpret_cast<uintptr_t>(buffer) + numBytes - start,
+                MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    // Kernels before 5.14 do not know MADV_POPULATE_WRITE
+    touchPages(tbb::blocked_range<size_t>(0, numPages));
+}
+
+void ContainerFactory::setAllocationBackend(ContainerLocation location, std::shared_ptr<AllocationBackend> backend) {
+    assert(location < LocationINVALID && backend);
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    sm_allocationBackends[location] = backend;
+    LOG(INFO) << "ContainerFactory: Using allocation backend " << backend->getName() << " for "
+              << locationName(location);
+}
+
+std::shared_ptr<AllocationBackend> ContainerFactory::getAllocationBackend(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    return sm_allocationBackends[location];
+}
+
+void ContainerFactory::setHugePagePolicy(HugePagePolicy policy, size_t thresholdBytes) {
+    sm_hostBackend->setHugePagePolicy(policy, thresholdBytes);
+}
+
+size_t ContainerFactory::getPageSize(const uint8_t *buffer) {
+    std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+    auto allocationIterator = sm_allocations.find(buffer);
+    return allocationIterator != sm_allocations.end() ? allocationIterator->second.pageSize : 0;
+}
+
+void ContainerFactory::requestReclaim(size_t numBytes, ContainerLocation location, bool waitFinished) {
+    std::unique_lock<std::mutex> reclaimLock(sm_reclaimMutex);
+    sm_reclaimBytes[location] += numBytes;
+    size_t generation = ++sm_reclaimRequestedGeneration;
+    sm_reclaimRequestedCondition.notify_one();
+    if (waitFinished) {
+        sm_reclaimFinishedCondition.wait(reclaimLock,
+                                         [generation]() { return sm_reclaimFinishedGeneration >= generation; });
+    }
+}
+
+void ContainerFactory::releaseUnderMemoryPressure() {
+    double pressureThreshold = sm_memoryPressureThreshold;
+    size_t minAvailable = sm_minAvailableMemory;
+    if (pressureThreshold <= 0 && minAvailable == 0) {
+        return;
+    }
+
+    // Only host memory counts against the system memory
+    size_t cachedBytes = getCachedBytes(LocationHost) + getCachedBytes(LocationShared);
+    if (cachedBytes == 0) {
+        return;
+    }
+    size_t releaseBytes = 0;
+    double pressure = pressureThreshold > 0 ? memoryPressure() : -1;
+    if (pressure > pressureThreshold) {
+        releaseBytes = cachedBytes;
+    } else if (minAvailable > 0) {
+        size_t available = availableMemoryBytes();
+        releaseBytes = available < minAvailable ? minAvailable - available : 0;
+    }
+    if (releaseBytes == 0) {
+        return;
+    }
+
+    size_t releasedBytes = evictLeastRecentlyReturned(releaseBytes, LocationHost);
+    if (releasedBytes < releaseBytes) {
+        releasedBytes += evictLeastRecentlyReturned(releaseBytes - releasedBytes, LocationShared);
+    }
+
+    // Only called by the garbage collection thread. Sustained pressure would log every check otherwise.
+    static size_t unloggedBytes = 0;
+    static double nextLogTime = 0;
+    unloggedBytes += releasedBytes;
+    if (unloggedBytes > 0 && getCurrentTime() >= nextLogTime) {
+        LOG(WARNING) << "ContainerFactory: Released " << unloggedBytes << " bytes of cached host buffers under "
+                     << "memory pressure (PSI " << pressure << " %, " << availableMemoryBytes()
+                     << " bytes available)";
+        unloggedBytes = 0;
+        nextLogTime = getCurrentTime() + sm_memoryPressureLogInterval;
+    }
+}
+
+void ContainerFactory::releaseCachedBuffers(ContainerLocation location) {
+    assert(location < LocationINVALID);
+    // Slots cached by threads keep their arenas, so they go back first, then the empty arenas go to the pool
+    drainThreadCaches(SIZE_MAX, location);
+    releaseEmptySlabArenas(location, std::numeric_limits<double>::infinity());
+    requestReclaim(getCachedBytes(location), location, true);
+}
+
+void ContainerFactory::setMemoryPressureThresholds(double pressurePercent, size_t minAvailableBytes) {
+    sm_memoryPressureThreshold = pressurePercent;
+    sm_minAvailableMemory = minAvailableBytes;
 }
 
 void ContainerFactory::freeOldBuffers() {
     double currentTime = getCurrentTime();
     double deleteTime = currentTime - sm_deallocationTimeout;
+
+    // The recency queues are ordered by return time, so only the expired buffers at their front have to be
+    // visited. The queues used for reuse are not touched, the entries of freed buffers are dropped from them
+    // when they are popped.
+    std::lock_guard<std::mutex> evictionLock(sm_evictionMutex);
     for (ContainerLocation location = LocationHost; location < LocationINVALID;
          location = static_cast<ContainerLocation>(location + 1)) {
-        for (auto mapIterator = sm_bufferMaps[location].begin(); mapIterator != sm_bufferMaps[location].end();
-             mapIterator++) {
-            size_t numBytesBuffer = mapIterator->first;
-
-            double lastTime = 0.0;
-            while (!mapIterator->second.empty() && lastTime < deleteTime) {
-                // If there is an element in this queue, remove it and free the memory
-                std::pair<uint8_t *, double> bufferPair;
-                if (mapIterator->second.try_pop(bufferPair)) {
-                    lastTime = bufferPair.second;
-                    if (lastTime < deleteTime) {
-                        freeMemory(bufferPair.first, numBytesBuffer, location);
-                    } else {
-                        // oops, we should not have taken that element from the queue. Let's just put it back.
-                        // Yes, it will be in the wrong temporal order, but that will be solved in a while on its own
-                        mapIterator->second.push(bufferPair);
-                    }
-                }
+        CachedBuffer *entry;
+        while ((entry = peekLeastRecentlyReturned(location)) && entry->returnTime < deleteTime) {
+            // Buffers pinned by a reservation do not expire, but they have to stay evictable. They are moved to
+            // the back of the recency queue, together with the reference the front held.
+            SizeClass *sizeClass = entry->sizeClass;
+            if (sizeClass->counters.getCachedBytes() <= sizeClass->numPinned * sizeClass->numBytes) {
+                entry->returnTime = currentTime;
+                sm_recencyQueues[location].push(entry);
+                sm_recencyFront[location] = nullptr;
+                continue;
             }
+            if (claimCachedBuffer(entry)) {
+                freeCachedBuffer(entry->pointer, *entry->sizeClass, location);
+            }
+            popLeastRecentlyReturned(location);
         }
+        discardBuddyBlocks(location, SIZE_MAX, deleteTime);
+    }
+    releaseExpiredThreadCaches(deleteTime);
+    // The arenas go back to the pool and expire from there
+    for (ContainerLocation location = LocationHost; location < LocationINVALID;
+         location = static_cast<ContainerLocation>(location + 1)) {
+        releaseEmptySlabArenas(location, deleteTime);
     }
 }
 
 void ContainerFactory::garbageCollectionThreadFunction() {
     sm_garbageCollectionThread.detach();
-    while (true) {
-        ContainerFactory::freeOldBuffers();
-        std::this_thread::sleep_for(std::chrono::duration<double>(sm_deallocationTimeout));
+    double nextSweepTime = getCurrentTime();
+    double nextStatisticsDumpTime = getCurrentTime();
+    double nextPressureCheckTime = getCurrentTime();
+    std::unique_lock<std::mutex> reclaimLock(sm_reclaimMutex);
+    while (!sm_garbageCollectionStopRequested) {
+        size_t generation = sm_reclaimRequestedGeneration;
+        std::array<size_t, LocationINVALID> reclaimBytes = sm_reclaimBytes;
+        sm_reclaimBytes.fill(0);
+        std::string statisticsDumpFile = sm_statisticsDumpFile;
+        double statisticsDumpInterval = sm_statisticsDumpInterval;
+        reclaimLock.unlock();
+
+        for (ContainerLocation location = LocationHost; location < LocationINVALID;
+             location = static_cast<ContainerLocation>(location + 1)) {
+            if (reclaimBytes[location] > 0) {
+                // An overshoot of the budget that is older than the requests is released as well
+                size_t budget = std::min(sm_memoryBudget[location], sm_memoryLimit[location]);
+                size_t numBytesHeld = getLiveBytes(location) + getCachedBytes(location);
+                size_t numBytesExcess = numBytesHeld > budget ? numBytesHeld - budget : 0;
+                evictLeastRecentlyReturned(std::max(reclaimBytes[location], numBytesExcess), location);
+            }
+        }
+        if (getCurrentTime() >= nextSweepTime) {
+            ContainerFactory::freeOldBuffers();
+            nextSweepTime = getCurrentTime() + sm_deallocationTimeout;
+        }
+        if (getCurrentTime() >= nextPressureCheckTime) {
+            releaseUnderMemoryPressure();
+            nextPressureCheckTime = getCurrentTime() + sm_memoryPressureInterval;
+        }
+        double nextWakeupTime = std::min(nextSweepTime, nextPressureCheckTime);
+        if (!statisticsDumpFile.empty()) {
+            if (getCurrentTime() >= nextStatisticsDumpTime) {
+                std::ofstream statisticsStream(statisticsDumpFile, std::ios::app);
+                dumpStatistics(statisticsStream);
+                nextStatisticsDumpTime = getCurrentTime() + statisticsDumpInterval;
+            }
+            nextWakeupTime = std::min(nextWakeupTime, nextStatisticsDumpTime);
+        }
+
+        reclaimLock.lock();
+        sm_reclaimFinishedGeneration = generation;
+        sm_reclaimFinishedCondition.notify_all();
+        sm_reclaimRequestedCondition.wait_for(
+            reclaimLock, std::chrono::duration<double>(std::max(nextWakeupTime - getCurrentTime(), 0.0)),
+            [&statisticsDumpFile]() {
+                return sm_reclaimRequestedGeneration != sm_reclaimFinishedGeneration ||
+                       sm_statisticsDumpFile != statisticsDumpFile || sm_garbageCollectionStopRequested;
+            });
     }
+    sm_garbageCollectionStopped = true;
+    sm_reclaimFinishedCondition.notify_all();
 }
 
-void ContainerFactory::freeMemory(uint8_t *pointer, [[maybe_unused]] size_t numBytes, ContainerLocation location) {
-    switch (location) {
-    case LocationGpu:
-#ifdef HAVE_CUDA
-        cudaFree(pointer);
-#endif
-        break;
-    case LocationBoth:
-#ifdef HAVE_CUDA
-        cudaFree(pointer);
-#endif
-        break;
-    case LocationHost:
-#ifdef HAVE_CUDA
-        cudaFreeHost(pointer);
-#else
-        delete[] pointer;
-#endif
-        break;
-    default:
-        break;
+ContainerFactory::GarbageCollectionGuard::~GarbageCollectionGuard() {
+    std::unique_lock<std::mutex> reclaimLock(sm_reclaimMutex);
+    sm_garbageCollectionStopRequested = true;
+    sm_reclaimRequestedCondition.notify_one();
+    sm_reclaimFinishedCondition.wait(reclaimLock, []() { return sm_garbageCollectionStopped; });
+}
+
+void ContainerFactory::freeMemory(uint8_t *pointer, [[maybe_unused]] size_t numBytes,
+                                  [[maybe_unused]] ContainerLocation location) {
+    // Blocks of split buffers go back to their parent
+    if (releaseBuddyBlock(pointer)) {
+        return;
+    }
+
+    Allocation allocation;
+    {
+        std::lock_guard<std::mutex> allocationsLock(sm_allocationsMutex);
+        auto allocationIterator = sm_allocations.find(pointer);
+        assert(allocationIterator != sm_allocations.end());
+        allocation = std::move(allocationIterator->second);
+        sm_allocations.erase(allocationIterator);
     }
+
+    // Free with the backend that allocated the buffer, which might not be the current one of its location
+    allocation.backend->free(
+        AllocationBackend::Block{pointer, allocation.numBytes, allocation.pageSize, allocation.mappedBytes, false});
 }
 
 std::vector<ContainerFactory::ContainerStreamType> ContainerFactory::sm_streams = {};
 size_t ContainerFactory::sm_streamIndex = 0;
 std::mutex ContainerFactory::sm_streamMutex;
-std::mutex ContainerFactory::sm_memoryMutex;
 
 constexpr double ContainerFactory::sm_deallocationTimeout;
+constexpr size_t ContainerFactory::sm_parallelZeroThreshold;
+constexpr size_t ContainerFactory::sm_sizeClassMinGranularity;
+constexpr size_t ContainerFactory::sm_minimumAlignment;
+constexpr size_t ContainerFactory::sm_deviceAlignment;
+constexpr size_t ContainerFactory::sm_latencyHistogramSize;
+constexpr size_t ContainerFactory::sm_counterShards;
+
+std::array<size_t, LocationINVALID> ContainerFactory::sm_sizeClassesPerDoubling = {16, 16, 16, 16};
+ContainerFactory::ThreadCacheLimits ContainerFactory::sm_defaultThreadCacheLimits = {4, 64 * 1024 * 1024, 2};
+std::array<size_t, LocationINVALID> ContainerFactory::sm_memoryBudget = {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX};
+std::array<size_t, LocationINVALID> ContainerFactory::sm_slabThreshold = {4096, 0, 0, 0};
+std::array<size_t, LocationINVALID> ContainerFactory::sm_memoryLimit = {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX};
+std::array<double, LocationINVALID> ContainerFactory::sm_admissionTimeout = {};
+std::array<std::atomic<size_t>, LocationINVALID> ContainerFactory::sm_admittedBytes;
+std::mutex ContainerFactory::sm_admissionMutex;
+std::condition_variable ContainerFactory::sm_admissionCondition;
+std::map<std::string, ContainerFactory::AdmissionStatistics> ContainerFactory::sm_admissionStatistics;
+std::atomic<bool> ContainerFactory::sm_nameAccounting(false);
+tbb::concurrent_unordered_map<std::string, NameAccount> ContainerFactory::sm_nameAccounts;
+std::array<bool, LocationINVALID> ContainerFactory::sm_buddySplitting = {false, false, false, false};
+constexpr size_t ContainerFactory::sm_slabArenaBytes;
+constexpr size_t ContainerFactory::sm_buddyMaxSplitFactor;
+constexpr size_t ContainerFactory::sm_slabMaxThreshold;
+std::array<ContainerFactory::Counters, LocationINVALID> ContainerFactory::sm_locationCounters;
+std::array<std::array<ContainerFactory::LatencyHistogram, ContainerFactory::sm_counterShards>, LocationINVALID>
+    ContainerFactory::sm_acquireLatencyHistograms = {};
+std::string ContainerFactory::sm_statisticsDumpFile;
+double ContainerFactory::sm_statisticsDumpInterval = 0;
+std::string ContainerFactory::sm_workingSetProfileFile;
+constexpr double ContainerFactory::sm_memoryPressureInterval;
+constexpr double ContainerFactory::sm_memoryPressureLogInterval;
+std::atomic<double> ContainerFactory::sm_memoryPressureThreshold(0);
+std::atomic<size_t> ContainerFactory::sm_minAvailableMemory(0);
+
+ContainerFactory::PrefaultPolicy ContainerFactory::sm_prefaultPolicy = PrefaultOff;
+size_t ContainerFactory::sm_prefaultThreshold = 16 * 1024 * 1024;
+std::shared_ptr<HostBackend> ContainerFactory::sm_hostBackend = std::make_shared<HostBackend>();
+std::mutex ContainerFactory::sm_allocationsMutex;
+#ifdef HAVE_CUDA
+std::array<std::shared_ptr<AllocationBackend>, LocationINVALID> ContainerFactory::sm_allocationBackends = {
+    std::make_shared<CudaBackend>(LocationHost), std::make_shared<CudaBackend>(LocationGpu),
+    std::make_shared<CudaBackend>(LocationBoth), std::make_shared<SharedMemoryBackend>()};
+#else
+std::array<std::shared_ptr<AllocationBackend>, LocationINVALID> ContainerFactory::sm_allocationBackends = {
+    sm_hostBackend, sm_hostBackend, sm_hostBackend, std::make_shared<SharedMemoryBackend>()};
+#endif
+std::unordered_map<const uint8_t *, ContainerFactory::Allocation> ContainerFactory::sm_allocations;
 
-std::array<tbb::concurrent_unordered_map<size_t, tbb::concurrent_queue<std::pair<uint8_t *, double>>>, LocationINVALID>
+std::array<tbb::concurrent_unordered_map<ContainerFactory::SizeClassKey, ContainerFactory::SizeClass,
+                                         ContainerFactory::SizeClassKeyHash>,
+           LocationINVALID>
     ContainerFactory::sm_bufferMaps;
+std::array<tbb::concurrent_unordered_map<ContainerFactory::SizeClassKey, ContainerFactory::SlabClass,
+                                         ContainerFactory::SizeClassKeyHash>,
+           LocationINVALID>
+    ContainerFactory::sm_slabMaps;
+std::array<ContainerFactory::BufferQueue, LocationINVALID> ContainerFactory::sm_recencyQueues;
+std::array<ContainerFactory::CachedBuffer *, LocationINVALID> ContainerFactory::sm_recencyFront = {};
+std::mutex ContainerFactory::sm_evictionMutex;
+std::mutex ContainerFactory::sm_threadCachesMutex;
+std::set<ContainerFactory::ThreadCache *> ContainerFactory::sm_threadCaches;
+std::mutex ContainerFactory::sm_buddyMutex;
+std::map<uint8_t *, ContainerFactory::BuddyParent> ContainerFactory::sm_buddyParents;
+std::unordered_map<const uint8_t *, ContainerFactory::BuddyBlock> ContainerFactory::sm_buddyBlocks;
+
+std::mutex ContainerFactory::sm_reclaimMutex;
+std::condition_variable ContainerFactory::sm_reclaimRequestedCondition;
+std::condition_variable ContainerFactory::sm_reclaimFinishedCondition;
+std::array<size_t, LocationINVALID> ContainerFactory::sm_reclaimBytes = {};
+size_t ContainerFactory::sm_reclaimRequestedGeneration = 0;
+size_t ContainerFactory::sm_reclaimFinishedGeneration = 0;
+bool ContainerFactory::sm_garbageCollectionStopRequested = false;
+bool ContainerFactory::sm_garbageCollectionStopped = false;
 
 std::thread ContainerFactory::sm_garbageCollectionThread(&ContainerFactory::garbageCollectionThreadFunction);
+ContainerFactory::GarbageCollectionGuard ContainerFactory::sm_garbageCollectionGuard;
 
 END_NAMESPACE_ESI
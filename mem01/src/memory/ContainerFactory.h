@@ -17,16 +17,106 @@
 #ifdef HAVE_CUDA
 #include "utilities/cudaUtility.h"
 #endif
+#include "utilities/numaUtility.h"
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_unordered_map.h>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 BEGIN_NAMESPACE_ESI
 
-enum ContainerLocation { LocationHost, LocationGpu, LocationBoth, LocationINVALID };
+/// LocationShared is host memory that other processes can attach to, see Container::getSharedMemoryHandle
+enum ContainerLocation { LocationHost, LocationGpu, LocationBoth, LocationShared, LocationINVALID };
+
+/// Identifies a LocationShared buffer across processes. The memory file stays valid as long as any process maps it.
+struct SharedMemoryHandle {
+    /// Process that owns the memory file descriptor
+    int processId;
+    /// The descriptor of the memory file in the owning process. It can be passed over a Unix socket, or another
+    /// process of the same user can open it as /proc/processId/fd/fileDescriptor.
+    int fileDescriptor;
+    /// Position of the buffer in the memory file
+    size_t offset;
+    size_t numBytes;
+};
+
+/// How the file of a file backed container is mapped
+enum FileMappingMode {
+    /// Writing to the container is not allowed
+    FileReadOnly,
+    /// Writes to the container go to the file
+    FileReadWrite
+};
+/// Access pattern a file backed container is expected to be read with, passed to the kernel with madvise
+enum FileAccessHint { FileAccessNormal, FileAccessSequential, FileAccessRandom, FileAccessWillNeed };
+
+class AllocationBackend;
+class HostBackend;
+class FrameArena;
+
+/// Counters of all containers with the same name, see ContainerFactory::setNameAccounting. The accounts are
+/// interned by name and never freed.
+struct NameAccount {
+    std::atomic<size_t> liveBytes{0};
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> peakBytes{0};
+};
+
+/// Describes how the buffer of a Container is allocated. acquireMemory resolves the requested options in place,
+/// returnMemory expects the resolved description back.
+struct ContainerAllocation {
+    /// NUMA node of a host or shared buffer, or NumaNodeLocal / NumaNodeInterleave. Resolves to 0 for other
+    /// locations and on systems with a single node.
+    int numaNode = NumaNodeLocal;
+    /// Set by acquireMemory if the buffer has been carved out of a slab arena
+    bool slab = false;
+    /// Set for buffers that are expected to live long, like slab arenas. They are never carved out of a larger idle
+    /// buffer, which they would keep from being freed.
+    bool longLived = false;
+    /// Set by acquireMemory to the size class of a pooled buffer, which it is returned to
+    size_t sizeClassBytes = 0;
+    /// If set, the buffer is allocated from this arena instead of the pool
+    FrameArena *frameArena = nullptr;
+    /// Minimum alignment of the buffer in bytes, a power of two of at most the page size. Host buffers are always
+    /// aligned to at least ContainerFactory::sm_minimumAlignment, buffers of at least a page to the page size.
+    /// Device buffers can only request the alignment CUDA guarantees.
+    size_t alignment = 0;
+    /// If set, the host buffer is growable up to maxNumBytes. Its address range is reserved upfront and pages are
+    /// only committed as the container grows, so growing never moves or copies the content.
+    size_t maxNumBytes = 0;
+    /// If set, the buffer is filled with zeros. New host buffers are mapped from fresh pages, which the kernel
+    /// zeroes anyway, only reused buffers are cleared, large ones in parallel. Device buffers are cleared
+    /// asynchronously on the stream.
+    bool zeroed = false;
+#ifdef HAVE_CUDA
+    /// Set by the container to its associated stream
+    cudaStream_t stream = nullptr;
+#endif
+    /// Name of the container the buffer is acquired for, the waits of the admission control are reported by it
+    const char *name = nullptr;
+    /// Set by the name accounting, the account the container is charged to and the bytes charged to it. Whether a
+    /// container is charged is decided once at construction, so resizing and destroying it stay consistent even if
+    /// the accounting is switched in between.
+    NameAccount *nameAccount = nullptr;
+    size_t accountedBytes = 0;
+    /// Set for file backed, attached and growable containers, the mapping that is unmapped when the container is
+    /// returned, and the committed part of a growable one
+    uint8_t *mapping = nullptr;
+    size_t mappingBytes = 0;
+    size_t committedBytes = 0;
+};
 
 class ContainerFactory {
   public:
@@ -38,36 +128,503 @@ class ContainerFactory {
 
     static ContainerStreamType getNextStream();
 
+    /// Alignment of all host buffers
+    static constexpr size_t sm_minimumAlignment = 64; // [bytes]
+    /// Alignment cudaMalloc guarantees for device buffers
+    static constexpr size_t sm_deviceAlignment = 256; // [bytes]
+    /// Returns the largest power of two, up to the page size, the address of the buffer is a multiple of
+    static size_t getAlignment(const uint8_t *buffer);
+
+    /// Configures the size classes used for pooling buffers of the given location.
+    /// Every power of two is subdivided into classesPerDoubling geometric classes (must be a power of two),
+    /// so the internal waste of a buffer is bounded by 1 / classesPerDoubling of its size.
+    /// 0 disables the binning and pools buffers by their exact size.
+    /// Buffers stay in the class they were acquired with, so changing the classes later only affects new requests.
+    static void setSizeClassesPerDoubling(ContainerLocation location, size_t classesPerDoubling);
+    /// Returns the size of the buffer that is used to serve a request of numBytes
+    static size_t getSizeClassBytes(size_t numBytes, ContainerLocation location);
+    /// Returns the number of bytes that live containers of the given location occupy beyond their requested size
+    static size_t getWastedBytes(ContainerLocation location);
+
+    /// Containers of the given location with at most numBytes share large pooled arenas, carved into slots of
+    /// their size class, instead of getting a buffer of their own. 0 disables the slabs for that location, which
+    /// is the default for all but LocationHost. Must not exceed sm_slabMaxThreshold.
+    static void setSlabThreshold(ContainerLocation location, size_t numBytes);
+    /// Size of the arenas the slabs are carved out of
+    static constexpr size_t sm_slabArenaBytes = 1024 * 1024; // [bytes]
+    /// Maximum slab threshold, so every arena holds a reasonable number of slots
+    static constexpr size_t sm_slabMaxThreshold = sm_slabArenaBytes / 16; // [bytes]
+
+    /// Lets requests of at least a page that miss the host pool be served from larger idle buffers, which are
+    /// split into halves buddy-style. Released halves coalesce again, and the split buffer is freed once all of its
+    /// blocks have been released. Free blocks count as cached. Their pages are dropped when they expire or have to
+    /// be evicted, and right away when the pool frees a block. Page-locked buffers are never split, and neither
+    /// are buffers more than sm_buddyMaxSplitFactor times the request, so a single small block cannot keep a
+    /// much larger buffer from being freed. Only available for LocationHost.
+    static void setBuddySplitting(ContainerLocation location, bool enabled);
+    static constexpr size_t sm_buddyMaxSplitFactor = 16;
+
+    /// Allocates count buffers for requests of numBytes, touches all their pages and puts them into the pool,
+    /// so the first containers of that size do not have to allocate. If pinned, the pool keeps at least that
+    /// many buffers of the size when they expire. They can still be released to keep the memory budget, by
+    /// releaseCachedBuffers and under memory pressure, which also drops their pins.
+    static void reserve(ContainerLocation location, size_t numBytes, size_t count, bool pinned = false,
+                        int numaNode = NumaNodeLocal);
+
+    /// Writes the peak number of simultaneously live buffers of each location and size class to a file
+    static bool saveWorkingSetProfile(const std::string &filename);
+    /// Reads a profile written by saveWorkingSetProfile and, if prewarm is set, reserves its buffers as far as the
+    /// budget and memory limit of their location allow. Lines that cannot be parsed are skipped.
+    static bool loadWorkingSetProfile(const std::string &filename, bool prewarm);
+    /// Loads the profile from the given file, if it exists, and saves the profile of this run to it at exit
+    static void enableWorkingSetProfile(const std::string &filename, bool prewarm = true);
+
+    /// How host buffers are backed by huge pages in the CPU-only build. The CUDA build maps host buffers with
+    /// small pages.
+    enum HugePagePolicy {
+        /// Always use the default allocator
+        HugePagesOff,
+        /// Map the buffer aligned to a huge page and advise the kernel to use transparent huge pages
+        HugePagesTransparent,
+        /// Map the buffer from the hugetlbfs pool, falling back to transparent huge pages
+        HugePagesHugetlbfs
+    };
+    /// Selects the huge page policy of the default host backend for buffers of at least thresholdBytes
+    static void setHugePagePolicy(HugePagePolicy policy, size_t thresholdBytes);
+    /// How new host buffers are faulted in before they are handed to a container
+    enum PrefaultPolicy {
+        /// Pages are faulted in by the first access of the container
+        PrefaultOff,
+        /// The kernel populates all pages in the allocating thread (MADV_POPULATE_WRITE), honouring the NUMA
+        /// placement of the buffer
+        PrefaultPopulate,
+        /// The pages are touched by TBB worker threads in parallel. Buffers without an explicit NUMA placement
+        /// are not bound to a node, so they are spread over the nodes of the workers by first touch. They are
+        /// pooled with the buffers of the allocating thread's node. Buffers with a placement stay on their node.
+        PrefaultParallel
+    };
+    /// Selects the prefault policy for new host buffers of at least thresholdBytes.
+    /// Buffers served from the pool have been faulted in already.
+    static void setPrefaultPolicy(PrefaultPolicy policy, size_t thresholdBytes);
+    static PrefaultPolicy getPrefaultPolicy();
+    /// Faults in all pages of the given host buffer, PrefaultOff populates them like PrefaultPopulate. Also used
+    /// by backends that have to fault in their buffers themselves.
+    static void prefault(uint8_t *buffer, size_t numBytes, PrefaultPolicy policy);
+
+    /// Selects the backend that allocates new buffers of the given location, so allocators can be compared on a
+    /// workload. Meant to be called at startup, buffers are always freed by the backend that allocated them.
+    static void setAllocationBackend(ContainerLocation location, std::shared_ptr<AllocationBackend> backend);
+    static std::shared_ptr<AllocationBackend> getAllocationBackend(ContainerLocation location);
+    /// Returns the size of the pages that back the given buffer, or 0 if it was not allocated by the factory
+    static size_t getPageSize(const uint8_t *buffer);
+
+    /// Limits of the per-thread buffer caches that sit in front of the global queues.
+    /// Buffers held in a thread cache count as cached. They expire like the buffers in the global queues and are
+    /// handed back to them when eviction runs out of other buffers, the limits bound what a thread keeps back
+    /// in between.
+    struct ThreadCacheLimits {
+        /// Maximum number of buffers a thread keeps per location and size class
+        size_t maxBuffersPerSize;
+        /// Maximum number of bytes a thread keeps in total. Larger buffers always use the global queues.
+        size_t maxBytes;
+        /// Number of buffers moved between the thread cache and the global queues at once
+        size_t batchSize;
+    };
+    /// Sets the thread cache limits of the calling thread
+    static void setThreadCacheLimits(const ThreadCacheLimits &limits);
+    /// Sets the thread cache limits used by threads that have not acquired or returned a buffer yet.
+    /// Should be called before the worker threads are started.
+    static void setDefaultThreadCacheLimits(const ThreadCacheLimits &limits);
+    /// Moves all buffers cached by the calling thread back to the global queues
+    static void flushThreadCache();
+
+    /// Sets the budget for the memory the pool holds for the given location, i.e. live and cached buffers.
+    /// If a new allocation would exceed it, cached buffers are released, the least recently returned first.
+    /// Live buffers are never released, so they alone can still exceed the budget.
+    static void setMemoryBudget(ContainerLocation location, size_t numBytes);
+    /// Caps the bytes of the live pooled buffers of the given location, SIZE_MAX removes the cap. An acquire that
+    /// would exceed the cap waits until other containers return enough memory, at most timeout seconds or
+    /// indefinitely if timeout is negative, and throws bad alloc after that. Before a new buffer would take the
+    /// live and cached buffers above the cap, the acquire waits until enough cached buffers have been released,
+    /// taking them from the caches of other threads as well if needed.
+    static void setMemoryLimit(ContainerLocation location, size_t numBytes, double timeout);
+    /// Lets the garbage collection thread release cached host buffers when the system runs short of memory:
+    /// all of them when the memory PSI exceeds pressurePercent, and as many as needed to get back to
+    /// minAvailableBytes of MemAvailable. Negative or zero values disable the respective check.
+    static void setMemoryPressureThresholds(double pressurePercent, size_t minAvailableBytes);
+    /// Releases all cached buffers of the given location and waits until they are freed
+    static void releaseCachedBuffers(ContainerLocation location);
+    /// Returns the number of bytes of idle buffers the pool keeps for the given location
+    static size_t getCachedBytes(ContainerLocation location);
+    /// Returns the number of bytes of buffers of the given location that are currently used by containers
+    static size_t getLiveBytes(ContainerLocation location);
+
+    /// Number of buckets of the acquire latency histograms
+    static constexpr size_t sm_latencyHistogramSize = 32;
+
+    /// Snapshot of the pool counters of a location or one of its size classes
+    struct Statistics {
+        size_t acquires;
+        size_t hits;
+        size_t misses;
+        /// Number of cached buffers that have been released
+        size_t frees;
+        size_t liveBytes;
+        size_t cachedBytes;
+        /// Bytes of live buffers beyond the requested sizes
+        size_t wastedBytes;
+        /// Maximum of liveBytes so far. It is updated on misses and whenever the counters are read, so a short
+        /// peak that is served from the pool alone can be missed.
+        size_t highWaterBytes;
+    };
+    /// Snapshot of the slabs of one slot size
+    struct SlabStatistics {
+        size_t arenas;
+        size_t slotsPerArena;
+        size_t usedSlots;
+    };
+    /// Snapshot of all counters of a location
+    struct LocationStatistics {
+        Statistics total;
+        /// Counters of each size class, by its buffer size and NUMA node
+        std::map<std::pair<size_t, int>, Statistics> sizeClasses;
+        /// Bucket k counts the calls of acquireMemory that took [2^k, 2^(k+1)) nanoseconds
+        std::array<size_t, sm_latencyHistogramSize> acquireLatencyHistogram;
+        /// Bytes of all allocated buffers, live and cached, by the size of the pages backing them
+        std::map<size_t, size_t> bytesByPageSize;
+        /// Occupancy of the slabs, by their slot size and NUMA node
+        std::map<std::pair<size_t, int>, SlabStatistics> slabClasses;
+        /// Number of split buffers, the bytes of their free blocks and how many of those are still resident.
+        /// The resident ones are part of cachedBytes.
+        size_t buddyParents;
+        size_t buddyFreeBytes;
+        size_t buddyResidentBytes;
+    };
+    /// Returns the current counters of the given location
+    static LocationStatistics getStatistics(ContainerLocation location);
+    /// Acquires that had to wait for the memory limit, for one container name
+    struct AdmissionStatistics {
+        size_t waits;
+        size_t timeouts;
+        double waitSeconds;
+        double maxWaitSeconds;
+    };
+    /// Returns the admission waits of all locations by the name of the waiting container, "" for unnamed ones
+    static std::map<std::string, AdmissionStatistics> getAdmissionStatistics();
+    /// Writes the counters of all locations as text
+    static void dumpStatistics(std::ostream &stream);
+    /// Lets the garbage collection thread append the counters to the given file every interval seconds.
+    /// An empty filename stops the dumps.
+    static void setStatisticsDumpFile(const std::string &filename, double interval);
+
+    /// Charges the bytes of every new container to its name, so the stages of a pipeline can be told apart by the
+    /// memory they own. Containers without a name are charged to "". Containers created while the accounting is
+    /// off are not counted.
+    static void setNameAccounting(bool enabled);
+    /// Snapshot of the account of one name
+    struct NameStatistics {
+        size_t liveBytes;
+        /// Number of containers created so far
+        size_t allocations;
+        /// Maximum of liveBytes so far
+        size_t peakBytes;
+    };
+    static std::map<std::string, NameStatistics> getNameStatistics();
+    /// Writes the accounts as text, the names owning the most live bytes first
+    static void dumpNameStatistics(std::ostream &stream);
+
+    /// Returns the handle other processes can attach to the given LocationShared buffer with
+    static SharedMemoryHandle getSharedMemoryHandle(const uint8_t *buffer, size_t numBytes);
+
   protected:
-    static uint8_t *acquireMemory(size_t numBytes, ContainerLocation location);
-    static void returnMemory(uint8_t *pointer, size_t numBytes, ContainerLocation location);
+    /// Reserves the address range of a growable buffer and commits numBytes of it
+    static uint8_t *reserveGrowable(size_t numBytes, ContainerLocation location, ContainerAllocation &allocation);
+    /// Commits the pages a growable buffer needs for numBytes
+    static void growMemory(size_t numBytes, ContainerAllocation &allocation);
+    /// Maps the shared buffer of another process, numBytes at its offset
+    static uint8_t *attachSharedMemory(const SharedMemoryHandle &handle, ContainerAllocation &allocation);
+    /// Maps numBytes of the given file, starting at offset, or the rest of the file if numBytes is 0.
+    /// The pages are only read when they are accessed.
+    static uint8_t *mapFile(const std::string &filename, FileMappingMode mode, FileAccessHint hint, size_t offset,
+                            size_t &numBytes, ContainerAllocation &allocation);
+    static uint8_t *acquireMemory(size_t numBytes, ContainerLocation location, ContainerAllocation &allocation);
+    static void returnMemory(uint8_t *pointer, size_t numBytes, ContainerLocation location,
+                             const ContainerAllocation &allocation);
+    /// Charges a new container to the account of its name, if the name accounting is enabled
+    static void accountAcquire(size_t numBytes, ContainerAllocation &allocation);
+    /// Charges the change of size of a resized container, if it has been charged at construction
+    static void accountResize(size_t numBytes, ContainerAllocation &allocation);
+    static void accountReturn(const ContainerAllocation &allocation);
 
   private:
+    class ThreadCache;
+
+    /// A buffer in the global queues. It is referenced both from the queue of its size and from the recency queue
+    /// of its location. Whoever claims it first, a reusing acquire or an eviction, owns the buffer.
+    struct SizeClass;
+    struct CachedBuffer {
+        uint8_t *pointer;
+        SizeClass *sizeClass;
+        double returnTime;
+        std::atomic<bool> claimed;
+        std::atomic<int> references;
+    };
+    typedef tbb::concurrent_queue<CachedBuffer *> BufferQueue;
+
+    /// Number of shards of the counters, each thread updates one of them
+    static constexpr size_t sm_counterShards = 16;
+    /// Counters behind Statistics. They are sharded by thread, so acquires and returns on different threads do
+    /// not contend for the same cache lines, and summed up when they are read.
+    struct Counters {
+        /// The counters of the threads of one shard. The byte counts of a single shard wrap around if its threads
+        /// return buffers other threads acquired, only their sums are meaningful. Padded to two cache lines, so
+        /// neighbouring shards never share one, even if they are not aligned to a cache line.
+        struct Shard {
+            std::atomic<size_t> acquires{0};
+            std::atomic<size_t> hits{0};
+            std::atomic<size_t> misses{0};
+            std::atomic<size_t> frees{0};
+            std::atomic<size_t> liveBytes{0};
+            std::atomic<size_t> cachedBytes{0};
+            std::atomic<size_t> wastedBytes{0};
+            char padding[128 - 7 * sizeof(std::atomic<size_t>)];
+        };
+        std::array<Shard, sm_counterShards> shards;
+        std::atomic<size_t> highWaterBytes{0};
+
+        void countAcquire(size_t numBytes, size_t numBytesWasted, bool hit);
+        void countReturn(size_t numBytes, size_t numBytesWasted);
+        void countFree(size_t numBytes);
+        void addCachedBytes(size_t numBytes);
+        void removeCachedBytes(size_t numBytes);
+        size_t getLiveBytes() const;
+        size_t getCachedBytes() const;
+        size_t getWastedBytes() const;
+        /// Returns the live bytes and raises the high water mark to them
+        size_t sampleLiveBytes();
+        Statistics snapshot();
+    };
+
+    /// Size classes are kept separately per NUMA node
+    typedef std::pair<size_t, int> SizeClassKey;
+    struct SizeClassKeyHash {
+        size_t operator()(const SizeClassKey &key) const {
+            return std::hash<size_t>()(key.first) ^ std::hash<int>()(key.second);
+        }
+    };
+
+    /// The global queue and the counters of the buffers of one size on one NUMA node
+    struct SizeClass {
+        explicit SizeClass(const SizeClassKey &key) : numBytes(key.first), numaNode(key.second) {}
+
+        const size_t numBytes;
+        const int numaNode;
+        BufferQueue queue;
+        Counters counters;
+        /// Number of cached buffers that are not released on expiry
+        std::atomic<size_t> numPinned{0};
+    };
+
+    /// A pooled buffer of sm_slabArenaBytes that is carved into slots. Slots are handed out from the start of the
+    /// arena first and reused through the free list, so the live slots stay dense.
+    struct SlabArena {
+        /// First slot, aligned to sm_sizeClassMinGranularity
+        uint8_t *firstSlot;
+        size_t numCarved;
+        size_t numUsed;
+        std::vector<uint8_t *> freeSlots;
+        /// Size class of the pooled buffer
+        size_t bufferBytes;
+        /// Time the last slot was returned, if no slot is used
+        double emptyTime;
+    };
+
+    /// The arenas of one slot size on one NUMA node. The free lists are kept outside of the slots, so they also
+    /// work for device memory.
+    struct SlabClass {
+        explicit SlabClass(const SizeClassKey &key)
+            : slotBytes(key.first), numaNode(key.second),
+              slotsPerArena((sm_slabArenaBytes - sm_sizeClassMinGranularity) / key.first) {}
+
+        const size_t slotBytes;
+        const int numaNode;
+        const size_t slotsPerArena;
+        std::mutex mutex;
+        /// All arenas by the start of their pooled buffer
+        std::map<uint8_t *, SlabArena> arenas;
+        /// The arenas that have free slots, lowest address first
+        std::set<uint8_t *> availableArenas;
+    };
+
+    /// A free block of a split buffer. Its resident bytes are 0 once its pages have been dropped.
+    struct FreeBuddyBlock {
+        double freeTime;
+        size_t residentBytes;
+    };
+    /// An idle buffer that has been split into buddy blocks. The block sizes are the buffer size divided by
+    /// powers of two, so every block is aligned to its size relative to the start of the buffer.
+    struct BuddyParent {
+        ContainerLocation location;
+        int numaNode;
+        size_t numBytes;
+        /// Free blocks by their size and offset. Sizes without free blocks are removed.
+        std::map<size_t, std::map<size_t, FreeBuddyBlock>> freeBlocks;
+        size_t numUsedBlocks;
+    };
+    /// A block of a split buffer that serves as a pooled buffer of its own
+    struct BuddyBlock {
+        uint8_t *parent;
+        size_t numBytes;
+    };
+
+    /// Bookkeeping of a buffer allocated by the factory
+    struct Allocation {
+        ContainerLocation location;
+        std::shared_ptr<AllocationBackend> backend;
+        size_t numBytes;
+        /// Size of the pages backing the buffer
+        size_t pageSize;
+        /// Length of the mapping if the buffer has been mapped directly, 0 otherwise
+        size_t mappedBytes;
+    };
+
     static void initStreams();
+    static ThreadCache &getThreadCache();
+    static void releaseExpiredThreadCaches(double expiryTime);
+    /// Hands buffers of the given location back from the thread caches to the global queues, until at least
+    /// numBytes have been handed back. Returns the number of bytes handed back.
+    static size_t drainThreadCaches(size_t numBytes, ContainerLocation location);
+    static size_t getCounterShard();
+    static const char *locationName(ContainerLocation location);
+    static int resolveNumaNode(int numaNode, ContainerLocation location);
+    static size_t alignedRequestBytes(size_t numBytes, ContainerLocation location,
+                                      const ContainerAllocation &allocation);
+    static SizeClass &getSizeClass(size_t numBytes, int numaNode, ContainerLocation location);
+    static SlabClass &getSlabClass(size_t slotBytes, int numaNode, ContainerLocation location);
+    static uint8_t *acquireSlabSlot(size_t numBytes, ContainerLocation location, int numaNode);
+    /// Requires the mutex of the slab class
+    static uint8_t *takeSlabSlot(SlabClass &slabClass);
+    static size_t takeSlabSlots(SlabClass &slabClass, uint8_t **slots, size_t maxCount);
+    static void returnSlabSlot(uint8_t *pointer, size_t numBytes, ContainerLocation location, int numaNode);
+    static void returnSlabSlots(SlabClass &slabClass, ContainerLocation location, uint8_t *const *slots,
+                                size_t count);
+    static void returnSlabArena(uint8_t *buffer, size_t numBytes, int numaNode, ContainerLocation location);
+    /// Returns the arenas without used slots that have been empty since before emptyTimeMax to the pool
+    static void releaseEmptySlabArenas(ContainerLocation location, double emptyTimeMax);
+    static bool claimCachedBuffer(CachedBuffer *entry);
+    static void releaseCachedBuffer(CachedBuffer *entry);
+    static CachedBuffer *peekLeastRecentlyReturned(ContainerLocation location);
+    static void popLeastRecentlyReturned(ContainerLocation location);
+    static void freeCachedBuffer(uint8_t *pointer, SizeClass &sizeClass, ContainerLocation location);
+    static size_t evictLeastRecentlyReturned(size_t numBytesMin, ContainerLocation location);
+    static size_t popFromQueue(SizeClass &sizeClass, uint8_t **buffers, size_t maxCount);
+    static void pushToQueue(SizeClass &sizeClass, ContainerLocation location, uint8_t *const *buffers, size_t count);
+    static void admitMemory(size_t numBytes, ContainerLocation location, const char *name);
+    static void releaseAdmission(size_t numBytes, ContainerLocation location);
+    static uint8_t *acquireBuddyBlock(size_t numBytes, ContainerLocation location, int numaNode);
+    static void insertBuddyBlock(BuddyParent &parent, size_t offset, size_t blockBytes, size_t residentBytes,
+                                 double freeTime);
+    static bool releaseBuddyBlock(uint8_t *pointer);
+    static size_t discardBuddyBlocks(ContainerLocation location, size_t numBytesMin, double freeTimeMax);
+    /// Returns whether the pages of the given buffer allocated by the factory cannot be dropped
+    static bool pagesLocked(const uint8_t *buffer);
 
     static constexpr size_t sm_numberStreams = 16;
 
     static std::vector<ContainerStreamType> sm_streams;
     static size_t sm_streamIndex;
     static std::mutex sm_streamMutex;
-    static std::mutex sm_memoryMutex;
 
     static constexpr double sm_deallocationTimeout = 5; // [seconds]
+    /// Host buffers of at least this size are zeroed by TBB worker threads in parallel
+    static constexpr size_t sm_parallelZeroThreshold = 4 * 1024 * 1024; // [bytes]
+    static constexpr size_t sm_sizeClassMinGranularity = 64; // [bytes]
+
+    static std::array<size_t, LocationINVALID> sm_sizeClassesPerDoubling;
+    static ThreadCacheLimits sm_defaultThreadCacheLimits;
+    static std::array<size_t, LocationINVALID> sm_memoryBudget;
+    /// The admission control. Admitted bytes are counted without the mutex, which only serializes the waiters.
+    static std::array<size_t, LocationINVALID> sm_memoryLimit;
+    static std::array<double, LocationINVALID> sm_admissionTimeout;
+    static std::array<std::atomic<size_t>, LocationINVALID> sm_admittedBytes;
+    static std::mutex sm_admissionMutex;
+    static std::condition_variable sm_admissionCondition;
+    static std::map<std::string, AdmissionStatistics> sm_admissionStatistics;
+    static std::atomic<bool> sm_nameAccounting;
+    static tbb::concurrent_unordered_map<std::string, NameAccount> sm_nameAccounts;
+    static std::array<size_t, LocationINVALID> sm_slabThreshold;
+    static std::array<bool, LocationINVALID> sm_buddySplitting;
+    static std::array<Counters, LocationINVALID> sm_locationCounters;
+    /// The acquire latency histograms are sharded like the counters
+    typedef std::array<std::atomic<size_t>, sm_latencyHistogramSize> LatencyHistogram;
+    static std::array<std::array<LatencyHistogram, sm_counterShards>, LocationINVALID> sm_acquireLatencyHistograms;
+    static std::string sm_statisticsDumpFile;
+    static double sm_statisticsDumpInterval;
+    static std::string sm_workingSetProfileFile;
+    static constexpr double sm_memoryPressureInterval = 1; // [seconds]
+    /// Releases under memory pressure are logged at most once per interval, summed up
+    static constexpr double sm_memoryPressureLogInterval = 60; // [seconds]
+    static std::atomic<double> sm_memoryPressureThreshold;
+    static std::atomic<size_t> sm_minAvailableMemory;
+
+    static PrefaultPolicy sm_prefaultPolicy;
+    static size_t sm_prefaultThreshold;
+    static std::shared_ptr<HostBackend> sm_hostBackend;
+    /// Guards the backends and the allocations
+    static std::mutex sm_allocationsMutex;
+    static std::array<std::shared_ptr<AllocationBackend>, LocationINVALID> sm_allocationBackends;
+    static std::unordered_map<const uint8_t *, Allocation> sm_allocations;
 
-    static uint8_t *allocateMemory(size_t numBytes, ContainerLocation location);
-    static void freeBuffers(size_t numBytesMin, ContainerLocation location);
+    static uint8_t *allocateMemory(size_t numBytes, ContainerLocation location, int numaNode, bool &zeroed);
+    static void zeroMemory(uint8_t *buffer, size_t numBytes, ContainerLocation location,
+                           const ContainerAllocation &allocation);
+    static void saveWorkingSetProfileAtExit();
+    static void requestReclaim(size_t numBytes, ContainerLocation location, bool waitFinished);
     static void freeOldBuffers();
+    static void releaseUnderMemoryPressure();
     static void garbageCollectionThreadFunction();
     static void freeMemory(uint8_t *pointer, size_t numBytes, ContainerLocation location);
 
-    static std::array<tbb::concurrent_unordered_map<size_t, tbb::concurrent_queue<std::pair<uint8_t *, double>>>,
-                      LocationINVALID>
+    static std::array<tbb::concurrent_unordered_map<SizeClassKey, SizeClass, SizeClassKeyHash>, LocationINVALID>
         sm_bufferMaps;
+    static std::array<tbb::concurrent_unordered_map<SizeClassKey, SlabClass, SizeClassKeyHash>, LocationINVALID>
+        sm_slabMaps;
+    /// Per location, all cached buffers in the order they were returned. Evictions are serialized by
+    /// sm_evictionMutex, which also guards the already popped front element sm_recencyFront.
+    static std::array<BufferQueue, LocationINVALID> sm_recencyQueues;
+    static std::array<CachedBuffer *, LocationINVALID> sm_recencyFront;
+    static std::mutex sm_evictionMutex;
+    /// All thread caches. Locked after sm_evictionMutex and before the mutex of each cache.
+    static std::mutex sm_threadCachesMutex;
+    static std::set<ThreadCache *> sm_threadCaches;
+    /// Split buffers by their start and the blocks handed out of them. A block is never split again, it is
+    /// released to its parent instead, so the start of a parent and of its first block can coincide.
+    static std::mutex sm_buddyMutex;
+    static std::map<uint8_t *, BuddyParent> sm_buddyParents;
+    static std::unordered_map<const uint8_t *, BuddyBlock> sm_buddyBlocks;
+
+    /// Allocating threads never free buffers themselves, they hand the bytes to reclaim to the garbage collection
+    /// thread. The generation counters allow a requester to wait until its request has been served.
+    static std::mutex sm_reclaimMutex;
+    static std::condition_variable sm_reclaimRequestedCondition;
+    static std::condition_variable sm_reclaimFinishedCondition;
+    static std::array<size_t, LocationINVALID> sm_reclaimBytes;
+    static size_t sm_reclaimRequestedGeneration;
+    static size_t sm_reclaimFinishedGeneration;
+    static bool sm_garbageCollectionStopRequested;
+    static bool sm_garbageCollectionStopped;
     static std::thread sm_garbageCollectionThread;
+
+    /// Stops the garbage collection thread at exit, before the members it waits on are destroyed
+    struct GarbageCollectionGuard {
+        ~GarbageCollectionGuard();
+    };
+    static GarbageCollectionGuard sm_garbageCollectionGuard;
 };
 
 class ContainerFactoryContainerInterface : public ContainerFactory {
     template <typename T> friend class Container;
+    friend class FrameArena;
 };
 
 END_NAMESPACE_ESI
@@ -0,0 +1,101 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2017, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#include "FrameArena.h"
+
+#include <cassert>
+#include <glog/logging.h>
+
+using namespace std;
+
+BEGIN_NAMESPACE_ESI
+
+FrameArena::FrameArena(ContainerLocation location, size_t blockBytes, int numaNode)
+    : m_blockBytes(blockBytes), m_blockIndex(0), m_blockOffset(0), m_numBytesUsed(0) {
+#ifndef HAVE_CUDA
+    location = LocationHost;
+#endif
+    assert(location < LocationINVALID);
+    if (blockBytes == 0) {
+        throw std::runtime_error("invalid argument: FrameArena: blockBytes must not be 0");
+    }
+    m_location = location;
+    m_blockAllocation.numaNode = numaNode;
+#ifndef NDEBUG
+    m_numLive = 0;
+#endif
+}
+
+FrameArena::~FrameArena() {
+    checkNoLiveContainers("destroyed");
+    for (auto &block : m_blocks) {
+        ContainerFactoryContainerInterface::returnMemory(block.pointer, block.numBytes, m_location, block.allocation);
+    }
+}
+
+uint8_t *FrameArena::allocate(size_t numBytes, size_t alignment) {
+    assert(alignment >= sm_alignment && (alignment & (alignment - 1)) == 0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Find the first block from the current one on that can hold the request, starting at an aligned address
+    while (m_blockIndex < m_blocks.size()) {
+        uintptr_t blockStart = reinterpret_cast<uintptr_t>(m_blocks[m_blockIndex].pointer);
+        uintptr_t start = (blockStart + m_blockOffset + alignment - 1) & ~(alignment - 1);
+        if (start + numBytes <= blockStart + m_blocks[m_blockIndex].numBytes) {
+            m_blockOffset = start + numBytes - blockStart;
+            break;
+        }
+        m_blockIndex++;
+        m_blockOffset = 0;
+    }
+
+    if (m_blockIndex == m_blocks.size()) {
+        size_t blockBytes = std::max(m_blockBytes, numBytes + alignment);
+        // acquireMemory resolves the options per block, e.g. small blocks are slab slots and large ones are not
+        ContainerAllocation allocation = m_blockAllocation;
+        uint8_t *block = ContainerFactoryContainerInterface::acquireMemory(blockBytes, m_location, allocation);
+        m_blocks.push_back(Block{block, blockBytes, allocation});
+        uintptr_t blockStart = reinterpret_cast<uintptr_t>(block);
+        m_blockOffset = ((blockStart + alignment - 1) & ~(alignment - 1)) + numBytes - blockStart;
+    }
+
+    m_numBytesUsed += numBytes;
+#ifndef NDEBUG
+    m_numLive++;
+#endif
+    return m_blocks[m_blockIndex].pointer + m_blockOffset - numBytes;
+}
+
+void FrameArena::reset() {
+    checkNoLiveContainers("reset");
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_blockIndex = 0;
+    m_blockOffset = 0;
+    m_numBytesUsed = 0;
+}
+
+ContainerAllocation FrameArena::getAllocation() {
+    ContainerAllocation allocation = m_blockAllocation;
+    allocation.frameArena = this;
+    return allocation;
+}
+
+void FrameArena::checkNoLiveContainers(const char *when) const {
+#ifndef NDEBUG
+    if (m_numLive != 0) {
+        LOG(FATAL) << "FrameArena: " << m_numLive << " containers escaped their frame, the arena has been " << when
+                   << " while they are still alive";
+    }
+#endif
+}
+
+constexpr size_t FrameArena::sm_alignment;
+
+END_NAMESPACE_ESI
@@ -0,0 +1,84 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2017, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#ifndef __FRAMEARENA_H__
+#define __FRAMEARENA_H__
+
+#include "ContainerFactory.h"
+#include "esiglobal.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+BEGIN_NAMESPACE_ESI
+
+/// Bump allocator for containers that live for exactly one frame. Its blocks are taken from the pool once and
+/// kept, containers constructed into the arena neither acquire nor return pool buffers. All of them are released
+/// at once by reset, which must only be called after all work on them has finished.
+/// Debug builds abort if a container of the arena is still alive when it is reset or destroyed.
+class FrameArena {
+  public:
+    FrameArena(ContainerLocation location, size_t blockBytes = 16 * 1024 * 1024, int numaNode = NumaNodeLocal);
+    ~FrameArena();
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    /// Returns numBytes of the current frame, aligned to alignment, a power of two of at least sm_alignment.
+    /// In debug builds, the allocation counts as live until containerReleased is called.
+    uint8_t *allocate(size_t numBytes, size_t alignment = sm_alignment);
+    /// Ends the frame, all memory of the arena can be allocated again
+    void reset();
+
+    ContainerLocation getLocation() const { return m_location; };
+    /// Returns the allocation that lets a Container be constructed into this arena
+    ContainerAllocation getAllocation();
+    /// Returns the number of bytes allocated in the current frame
+    size_t getUsedBytes() const { return m_numBytesUsed; };
+
+    /// Called by a Container of the arena when it is destroyed
+    void containerReleased() {
+#ifndef NDEBUG
+        m_numLive--;
+#endif
+    };
+
+    static constexpr size_t sm_alignment = 64; // [bytes]
+
+  private:
+    /// A pooled block with the allocation acquireMemory resolved for it, which it has to be returned with
+    struct Block {
+        uint8_t *pointer;
+        size_t numBytes;
+        ContainerAllocation allocation;
+    };
+
+    void checkNoLiveContainers(const char *when) const;
+
+    ContainerLocation m_location;
+    size_t m_blockBytes;
+    /// The options new blocks are acquired with
+    ContainerAllocation m_blockAllocation;
+
+    std::mutex m_mutex;
+    /// Requests larger than a block get a block of their own
+    std::vector<Block> m_blocks;
+    size_t m_blockIndex;
+    size_t m_blockOffset;
+    size_t m_numBytesUsed;
+#ifndef NDEBUG
+    std::atomic<ptrdiff_t> m_numLive;
+#endif
+};
+
+END_NAMESPACE_ESI
+
+#endif //!__FRAMEARENA_H__
@@ -0,0 +1,134 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2016, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#include "numaUtility.h"
+#include "utility.h"
+#include "glog/logging.h"
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Memory policies of the mbind system call, see linux/mempolicy.h
+#define ESI_MPOL_PREFERRED 1
+#define ESI_MPOL_INTERLEAVE 3
+
+using namespace std;
+
+BEGIN_NAMESPACE_ESI
+
+/// NUMA topology of the system as reported by sysfs, read once
+struct NumaTopology {
+    NumaTopology() {
+        while (fileExists("/sys/devices/system/node/node" + to_string(nodeCpus.size()) + "/cpulist")) {
+            std::ifstream cpuListFile("/sys/devices/system/node/node" + to_string(nodeCpus.size()) + "/cpulist");
+            std::string cpuList;
+            std::getline(cpuListFile, cpuList);
+
+            // The list has the form "0-3,8-11"
+            std::vector<int> cpus;
+            for (const std::string &range : split(trim(cpuList), ',')) {
+                std::vector<std::string> bounds = split(range, '-');
+                if (bounds.empty()) {
+                    continue;
+                }
+                int first = from_string<int>(bounds[0]);
+                int last = bounds.size() > 1 ? from_string<int>(bounds[1]) : first;
+                for (int cpu = first; cpu <= last; cpu++) {
+                    cpus.push_back(cpu);
+                    if (static_cast<size_t>(cpu) >= cpuNodes.size()) {
+                        cpuNodes.resize(cpu + 1, 0);
+                    }
+                    cpuNodes[cpu] = static_cast<int>(nodeCpus.size());
+                }
+            }
+            nodeCpus.push_back(cpus);
+        }
+        if (nodeCpus.empty()) {
+            nodeCpus.resize(1);
+        }
+    }
+
+    std::vector<std::vector<int>> nodeCpus;
+    std::vector<int> cpuNodes;
+};
+
+static const NumaTopology &getNumaTopology() {
+    static const NumaTopology topology;
+    return topology;
+}
+
+int numaNodeCount() { return static_cast<int>(getNumaTopology().nodeCpus.size()); }
+
+int numaCurrentNode() {
+    const NumaTopology &topology = getNumaTopology();
+    int cpu = sched_getcpu();
+    if (cpu < 0 || static_cast<size_t>(cpu) >= topology.cpuNodes.size()) {
+        return 0;
+    }
+    return topology.cpuNodes[cpu];
+}
+
+bool numaBindThread(int node) {
+    const NumaTopology &topology = getNumaTopology();
+    if (node < 0 || node >= numaNodeCount() || topology.nodeCpus[node].empty()) {
+        return false;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : topology.nodeCpus[node]) {
+        CPU_SET(cpu, &cpuSet);
+    }
+    return sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0;
+}
+
+bool numaBindMemory(void *address, size_t length, int node) {
+    if (numaNodeCount() <= 1) {
+        return true;
+    }
+    if (node < 0 || node >= numaNodeCount() || node >= static_cast<int>(sizeof(unsigned long) * 8)) {
+        return false;
+    }
+
+    unsigned long nodeMask = 1UL << node;
+    if (syscall(SYS_mbind, address, length, ESI_MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8, 0) != 0) {
+        LOG(WARNING) << "numaBindMemory: mbind to node " << node << " failed: " << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool numaInterleaveMemory(void *address, size_t length) {
+    if (numaNodeCount() <= 1) {
+        return true;
+    }
+
+    unsigned long nodeMask = 0;
+    for (int node = 0; node < numaNodeCount() && node < static_cast<int>(sizeof(unsigned long) * 8); node++) {
+        nodeMask |= 1UL << node;
+    }
+    if (syscall(SYS_mbind, address, length, ESI_MPOL_INTERLEAVE, &nodeMask, sizeof(nodeMask) * 8, 0) != 0) {
+        LOG(WARNING) << "numaInterleaveMemory: mbind failed: " << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool numaPlaceMemory(void *address, size_t length, int node) {
+    if (node == NumaNodeInterleave) {
+        return numaInterleaveMemory(address, length);
+    } else if (node == NumaNodeLocal) {
+        return true;
+    }
+    return numaBindMemory(address, length, node);
+}
+
+END_NAMESPACE_ESI
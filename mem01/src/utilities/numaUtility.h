@@ -0,0 +1,48 @@
+// ================================================================================================
+//
+// If not explicitly stated: Copyright (C) 2016, all rights reserved,
+//      Rüdiger Göbl
+//		Email r.goebl@tum.de
+//      Chair for Computer Aided Medical Procedures
+//      Technische Universität München
+//      Boltzmannstr. 3, 85748 Garching b. München, Germany
+//
+// ================================================================================================
+
+#ifndef __NUMAUTILITY_H__
+#define __NUMAUTILITY_H__
+
+#include "esiglobal.h"
+#include <stddef.h>
+
+BEGIN_NAMESPACE_ESI
+
+/// Places a host buffer on the NUMA node of the thread that allocates it
+constexpr int NumaNodeLocal = -1;
+/// Interleaves the pages of a host buffer over all NUMA nodes
+constexpr int NumaNodeInterleave = -2;
+
+/// Returns the number of NUMA nodes of the system, 1 if it is not a NUMA system
+int numaNodeCount();
+
+/// Returns the NUMA node of the CPU the calling thread is running on
+int numaCurrentNode();
+
+/// Restricts the calling thread to the CPUs of the given NUMA node
+bool numaBindThread(int node);
+
+/// Places the pages of the given page aligned range on the given node, as far as the node has free memory.
+/// Has to be called before the pages are touched.
+bool numaBindMemory(void *address, size_t length, int node);
+
+/// Interleaves the pages of the given page aligned range over all nodes.
+/// Has to be called before the pages are touched.
+bool numaInterleaveMemory(void *address, size_t length);
+
+/// Binds the given page aligned range to the given node, interleaves it for NumaNodeInterleave and leaves it to
+/// the first touch for NumaNodeLocal. Has to be called before the pages are touched.
+bool numaPlaceMemory(void *address, size_t length, int node);
+
+END_NAMESPACE_ESI
+
+#endif // !__NUMAUTILITY_H__
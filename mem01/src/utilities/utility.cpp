@@ -201,6 +201,35 @@ double availableMemory() {
     return mem;
 }
 
+double memoryPressure() {
+    std::ifstream pressureFile("/proc/pressure/memory");
+    std::string line;
+    while (std::getline(pressureFile, line)) {
+        // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        if (line.compare(0, 11, "some avg10=") == 0) {
+            return std::stod(line.substr(11));
+        }
+    }
+    return -1;
+}
+
+size_t availableMemoryBytes() {
+    std::ifstream memoryInfoFile("/proc/meminfo");
+    std::string key;
+    size_t value;
+    std::string unit;
+    while (memoryInfoFile >> key >> value) {
+        std::getline(memoryInfoFile, unit);
+        if (key == "MemAvailable:") {
+            return value * 1024;
+        }
+    }
+    // Kernels before 3.14 do not report MemAvailable
+    struct sysinfo memInfo;
+    sysinfo(&memInfo);
+    return (static_cast<size_t>(memInfo.freeram) + memInfo.bufferram) * memInfo.mem_unit;
+}
+
 // pw缓冲区中每条线存一条记录, 按线数显示会造成混淆，按每500线30帧做个转换
 int pwLineNumberToFrameNumber(int lineNum) { return lineNum * 500.0 / 500; }
 
@@ -177,6 +177,11 @@ bool writeFile(const std::string &filename, char *buffer, int size);
 
 double usedMemory();
 double availableMemory();
+/// Returns the share of the last 10 seconds in which some tasks stalled on memory in percent (Linux PSI),
+/// -1 if the kernel does not provide it
+double memoryPressure();
+/// Returns the kernel's estimate of the memory available without swapping in bytes (MemAvailable)
+size_t availableMemoryBytes();
 
 int pwLineNumberToFrameNumber(int lineNum);
 